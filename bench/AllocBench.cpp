@@ -0,0 +1,253 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <nlohmann/json.hpp>
+
+#include "Bench.h"
+#include "AuthService.h"
+#include "Database.h"
+#include "HttpServer.h"
+#include "WeatherCache.h"
+#include "WeatherClient.h"
+
+// I count every operator new in the process while `counting` is set,
+// except on threads that mark themselves excluded (the bench client and
+// the canned upstream), so what is left is the server's own work.
+// Replacing the global operators affects the whole weather_bench binary;
+// outside this suite it costs one relaxed load per allocation.
+static std::atomic<bool> counting{false};
+static std::atomic<std::uint64_t> allocations{0};
+static thread_local bool excluded = false;
+
+static void* countedAlloc(std::size_t size, std::size_t alignment) {
+    if (counting.load(std::memory_order_relaxed) && !excluded) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (size == 0) size = 1;
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+        p = std::malloc(size);
+    } else {
+#if defined(_MSC_VER)
+        p = _aligned_malloc(size, alignment);
+#else
+        if (posix_memalign(&p, alignment, size) != 0) p = nullptr;
+#endif
+    }
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+static void countedFree(void* p, std::size_t alignment) noexcept {
+#if defined(_MSC_VER)
+    if (alignment > alignof(std::max_align_t)) return _aligned_free(p);
+#else
+    (void)alignment;
+#endif
+    std::free(p);
+}
+
+void* operator new(std::size_t size) { return countedAlloc(size, 0); }
+void* operator new[](std::size_t size) { return countedAlloc(size, 0); }
+void* operator new(std::size_t size, std::align_val_t a) { return countedAlloc(size, static_cast<std::size_t>(a)); }
+void* operator new[](std::size_t size, std::align_val_t a) { return countedAlloc(size, static_cast<std::size_t>(a)); }
+void operator delete(void* p) noexcept { countedFree(p, 0); }
+void operator delete[](void* p) noexcept { countedFree(p, 0); }
+void operator delete(void* p, std::size_t) noexcept { countedFree(p, 0); }
+void operator delete[](void* p, std::size_t) noexcept { countedFree(p, 0); }
+void operator delete(void* p, std::align_val_t a) noexcept { countedFree(p, static_cast<std::size_t>(a)); }
+void operator delete[](void* p, std::align_val_t a) noexcept { countedFree(p, static_cast<std::size_t>(a)); }
+void operator delete(void* p, std::size_t, std::align_val_t a) noexcept { countedFree(p, static_cast<std::size_t>(a)); }
+void operator delete[](void* p, std::size_t, std::align_val_t a) noexcept { countedFree(p, static_cast<std::size_t>(a)); }
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+using tcp = net::ip::tcp;
+
+static const char* kAllocDb = "weather_alloc_bench.db";
+static const unsigned short kServerPort = 18771;
+static const unsigned short kUpstreamPort = 18772;
+
+static void removeAllocFiles() {
+    std::remove(kAllocDb);
+    std::remove((std::string(kAllocDb) + "-wal").c_str());
+    std::remove((std::string(kAllocDb) + "-shm").c_str());
+}
+
+static std::atomic<bool> upstreamDone{false};
+
+// I answer every upstream call with the same recorded payload.
+static void serveUpstream(tcp::acceptor& acceptor, const std::string& payload) {
+    excluded = true;
+    for (;;) {
+        tcp::socket socket(acceptor.get_executor());
+        beast::error_code ec;
+        acceptor.accept(socket, ec);
+        if (ec || upstreamDone.load()) return;
+
+        beast::flat_buffer buffer;
+        for (;;) {
+            http::request<http::string_body> req;
+            http::read(socket, buffer, req, ec);
+            if (ec) break;
+            http::response<http::string_body> res{ http::status::ok, req.version() };
+            res.set(http::field::content_type, "application/json");
+            res.body() = payload;
+            res.keep_alive(true);
+            res.prepare_payload();
+            http::write(socket, res, ec);
+            if (ec) break;
+        }
+    }
+}
+
+// I keep one keep-alive connection to the server, like a browser would.
+struct BenchClient {
+    net::io_context ioc;
+    beast::tcp_stream stream{ioc};
+    beast::flat_buffer buffer;
+    http::request<http::string_body> req;
+    http::response<http::string_body> res;
+
+    bool connect() {
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            beast::error_code ec;
+            stream.socket().close(ec);
+            stream.socket().connect({ net::ip::make_address("127.0.0.1"), kServerPort }, ec);
+            if (!ec) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        return false;
+    }
+
+    const std::string& send(http::verb method, const std::string& target, const std::string& body,
+                            const std::string& token) {
+        req = {};
+        req.method(method);
+        req.target(target);
+        req.version(11);
+        req.set(http::field::host, "127.0.0.1");
+        if (!token.empty()) req.set(http::field::authorization, "Bearer " + token);
+        req.body() = body;
+        req.prepare_payload();
+        http::write(stream, req);
+
+        res = {};
+        http::read(stream, buffer, res);
+        return res.body();
+    }
+};
+
+static void setApiKey() {
+#if defined(_WIN32)
+    _putenv_s("WEATHERAPI_KEY", "bench");
+#else
+    setenv("WEATHERAPI_KEY", "bench", 1);
+#endif
+}
+
+void runAllocBench() {
+    excluded = true;
+    removeAllocFiles();
+    setApiKey();
+
+    std::ifstream in(std::string(WEATHERAPP_BENCH_DATA) + "/paris.json", std::ios::binary);
+    std::ostringstream text;
+    text << in.rdbuf();
+    std::string payload = text.str();
+
+    net::io_context upstreamContext;
+    tcp::acceptor upstreamAcceptor(upstreamContext, { net::ip::make_address("127.0.0.1"), kUpstreamPort });
+    std::thread upstreamThread(serveUpstream, std::ref(upstreamAcceptor), std::cref(payload));
+
+    {
+        Database db(kAllocDb);
+        AuthService auth(db);
+
+        WeatherClientOptions clientOptions;
+        clientOptions.upstream.scheme = "http";
+        clientOptions.upstream.host = "127.0.0.1";
+        clientOptions.upstream.port = std::to_string(kUpstreamPort);
+        WeatherClient client(clientOptions);
+        WeatherCache weather(client);
+
+        // I keep the rate limiters on, since they run on every request,
+        // but far out of reach; one client sends everything over one
+        // connection.
+        ServerOptions options;
+        options.ioThreads = 1;
+        options.workerThreads = 2;
+        options.maxRequestsPerConnection = 1000000;
+        options.tokenRateLimit = RateLimitOptions{ 1e9, 1e9 };
+        options.ipRateLimit = RateLimitOptions{ 1e9, 1e9 };
+        HttpServer server("127.0.0.1", kServerPort, db, auth, weather, options);
+        std::thread serverThread([&server] { server.run(); });
+
+        BenchClient http;
+        if (!http.connect()) {
+            bench::check(false, "could not connect to the bench server");
+        } else {
+            http.send(http::verb::post, "/auth/register", R"({"username":"alloc","password":"bench"})", "");
+            std::string token = nlohmann::json::parse(
+                http.send(http::verb::post, "/auth/login", R"({"username":"alloc","password":"bench"})", ""))
+                .at("token").get<std::string>();
+
+            const std::string city = R"({"city":"Paris"})";
+            // I fail the run when a route goes over its budget. /weather/current
+            // keeps a few: the query-log entry with its strings, which is
+            // queued to the writer and outlives the request, and the JSON
+            // lexer's buffers.
+            auto perRequest = [&](const char* name, double budget, std::size_t iterations, auto&& request) {
+                // I warm caches, pools and the statement cache first.
+                for (std::size_t i = 0; i < 500; ++i) request();
+
+                allocations.store(0, std::memory_order_relaxed);
+                counting.store(true, std::memory_order_relaxed);
+                bench::measure(name, iterations, [&](std::size_t) { request(); });
+                counting.store(false, std::memory_order_relaxed);
+                double perCall = static_cast<double>(allocations.load(std::memory_order_relaxed)) / iterations;
+                std::printf("  %-58s %12.2f allocations/request\n", name, perCall);
+
+                char what[128];
+                std::snprintf(what, sizeof(what), "%s made %.2f allocations/request, budget %.0f",
+                              name, perCall, budget);
+                bench::check(perCall <= budget, what);
+            };
+
+            perRequest("GET /health", 1, 5000, [&] {
+                http.send(http::verb::get, "/health", "", "");
+            });
+            perRequest("POST /weather/current (cache hit)", 8, 5000, [&] {
+                http.send(http::verb::post, "/weather/current", city, token);
+            });
+            perRequest("GET /history?limit=20", 1, 5000, [&] {
+                http.send(http::verb::get, "/history?limit=20", "", token);
+            });
+        }
+
+        server.stop();
+        serverThread.join();
+    }
+
+    // Closing the acceptor does not wake a blocked accept on every
+    // platform, so I connect once more after raising the flag.
+    upstreamDone.store(true);
+    {
+        tcp::socket wake(upstreamContext);
+        beast::error_code ec;
+        wake.connect({ net::ip::make_address("127.0.0.1"), kUpstreamPort }, ec);
+    }
+    upstreamThread.join();
+    removeAllocFiles();
+}
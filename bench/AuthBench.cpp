@@ -0,0 +1,57 @@
+#include <string>
+#include <vector>
+
+#include "AuthService.h"
+#include "Bench.h"
+#include "SessionManager.h"
+
+void runAuthBench() {
+    const std::size_t iterations = 200000;
+    const std::size_t sessionCount = 10000;
+    const unsigned threads = 4;
+
+    std::size_t sink = 0;
+    bench::measure("AuthService::hashPassword", iterations, [&](std::size_t i) {
+        sink += AuthService::hashPassword(i % 2 ? "correct horse" : "battery staple").size();
+    });
+
+    // I size the session table like a busy server rather than a toy one.
+    SessionOptions memoryOptions;
+    memoryOptions.maxSessionsPerUser = sessionCount;
+    SessionManager memory(memoryOptions);
+
+    std::vector<std::string> tokens;
+    tokens.reserve(sessionCount);
+    bench::measure("createSession (in-memory)", sessionCount, [&](std::size_t i) {
+        tokens.push_back(memory.createSession(static_cast<int>(i % 100), "user"));
+    });
+
+    bench::measure("validateToken (in-memory)", iterations, [&](std::size_t i) {
+        Session session;
+        sink += memory.validateToken(tokens[i % sessionCount], session);
+    });
+    bench::measureParallel("validateToken (in-memory) x" + std::to_string(threads),
+                           threads, iterations / threads, [&](unsigned t, std::size_t i) {
+        Session session;
+        memory.validateToken(tokens[(t * 7919 + i) % sessionCount], session);
+    });
+    bench::measure("validateToken, unknown token", iterations, [&](std::size_t) {
+        Session session;
+        sink += memory.validateToken("0123456789abcdef0123456789abcdef", session);
+    });
+
+    SessionOptions signedOptions;
+    signedOptions.signingKeys.push_back(SigningKey{ "bench", "bench-secret" });
+    SessionManager stateless(signedOptions);
+
+    std::vector<std::string> signedTokens;
+    for (std::size_t i = 0; i < 64; ++i) {
+        signedTokens.push_back(stateless.createSession(static_cast<int>(i), "user"));
+    }
+    bench::measure("validateToken (HMAC-signed)", iterations, [&](std::size_t i) {
+        Session session;
+        sink += stateless.validateToken(signedTokens[i % signedTokens.size()], session);
+    });
+
+    if (sink == 1) std::printf("%zu\n", sink);
+}
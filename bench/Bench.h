@@ -0,0 +1,71 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// I keep the benchmark harness tiny and dependency-free so it builds
+// wherever WeatherApp builds. Each suite is a plain function.
+void runDatabaseBench();
+void runHistoryBench();
+void runRouterBench();
+void runParseBench();
+void runAuthBench();
+void runJsonBench();
+void runMetricsBench();
+void runCompressBench();
+void runAllocBench();
+
+namespace bench {
+
+// I count failed checks across suites; weather_bench exits non-zero when
+// any suite recorded one, so a regression can fail a build.
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+// I print a failed expectation and remember it.
+inline void check(bool ok, const std::string& what) {
+    if (ok) return;
+    std::printf("  FAILED: %s\n", what.c_str());
+    ++failures();
+}
+
+// I time `iterations` calls of fn on the calling thread and print
+// throughput in the same format for every suite.
+template <class Fn>
+double measure(const std::string& name, std::size_t iterations, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) fn(i);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double perSecond = iterations / elapsed.count();
+    std::printf("  %-58s %12.0f ops/s %10.1f ns/op\n",
+                name.c_str(), perSecond, 1e9 * elapsed.count() / iterations);
+    return perSecond;
+}
+
+// I run fn(threadIndex, i) on `threads` threads, `iterations` times each,
+// and report aggregate throughput.
+template <class Fn>
+double measureParallel(const std::string& name, unsigned threads, std::size_t iterations, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&fn, t, iterations] {
+            for (std::size_t i = 0; i < iterations; ++i) fn(t, i);
+        });
+    }
+    for (auto& th : pool) th.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double total = static_cast<double>(iterations) * threads;
+    double perSecond = total / elapsed.count();
+    std::printf("  %-58s %12.0f ops/s %10.1f ns/op\n",
+                name.c_str(), perSecond, 1e9 * elapsed.count() / total);
+    return perSecond;
+}
+
+} // namespace bench
@@ -0,0 +1,62 @@
+#include <cstdio>
+#include <string>
+
+#include <zlib.h>
+
+#include "Bench.h"
+#include "JsonWriter.h"
+#include "ResponseCompressor.h"
+
+// I reproduce compressing with a fresh zlib stream per response, so the
+// per-thread reuse in compressBody has a baseline.
+static std::size_t compressFresh(const std::string& in, int level) {
+    z_stream zs{};
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+
+    std::string out(deflateBound(&zs, static_cast<uLong>(in.size())) + 18, '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+
+    std::size_t size = zs.total_out;
+    deflateEnd(&zs);
+    return size;
+}
+
+// I compress a /history page of 100 rows, the body compression is for.
+void runCompressBench() {
+    const std::size_t iterations = 5000;
+
+    std::string page = "[";
+    for (int i = 0; i < 100; ++i) {
+        if (i > 0) page += ',';
+        page += "{\"id\":";
+        json_writer::appendNumber(page, static_cast<long long>(100000 + i));
+        page += ",\"timestamp\":\"2026-10-16 12:";
+        page += std::to_string(10 + i % 50) + ":00\",\"city\":";
+        json_writer::appendString(page, i % 3 ? "Paris" : "Oslo");
+        page += ",\"summary\":";
+        json_writer::appendString(page, "Weather in Paris: 14.0C, Light rain, wind 11.2 kph, humidity 88%");
+        page += '}';
+    }
+    page += ']';
+
+    std::string out;
+    for (int level : { 1, 6 }) {
+        compressBody(page, ContentCoding::gzip, level, out);
+        std::printf("  history page %zu bytes -> %zu bytes gzip at level %d\n",
+                    page.size(), out.size(), level);
+
+        std::size_t sink = 0;
+        bench::measure("gzip page, new zlib stream per body, level " + std::to_string(level) + " (before)",
+                       iterations, [&](std::size_t) { sink += compressFresh(page, level); });
+        bench::measure("gzip page, per-thread zlib stream, level " + std::to_string(level) + " (after)",
+                       iterations, [&](std::size_t) {
+            compressBody(page, ContentCoding::gzip, level, out);
+            sink += out.size();
+        });
+        if (sink == 0) std::printf("  (unexpected empty output)\n");
+    }
+}
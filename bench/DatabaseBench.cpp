@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include <sqlite3.h>
+
+#include "Bench.h"
+#include "Database.h"
+
+// I benchmark against a scratch file because reader pooling needs
+// a real WAL database that several connections can open.
+static const char* kBenchDb = "weather_bench.db";
+
+static void removeBenchFiles() {
+    std::remove(kBenchDb);
+    std::remove((std::string(kBenchDb) + "-wal").c_str());
+    std::remove((std::string(kBenchDb) + "-shm").c_str());
+}
+
+// I reproduce the old code path (prepare, bind, step, finalize per call
+// on one shared handle) so the cached/pooled numbers have a baseline.
+static int authenticateUncached(sqlite3* db, const std::string& user, const std::string& hash) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT id FROM users WHERE username = ? AND password = ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return -1;
+
+    sqlite3_bind_text(stmt, 1, user.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, hash.c_str(), -1, SQLITE_TRANSIENT);
+
+    int id = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return id;
+}
+
+void runDatabaseBench() {
+    const std::size_t users = 1000;
+    const std::size_t iterations = 200000;
+    const unsigned threads = 4;
+
+    removeBenchFiles();
+    {
+        Database db(kBenchDb);
+        for (std::size_t i = 0; i < users; ++i) {
+            db.createUser("user" + std::to_string(i), "hash" + std::to_string(i));
+        }
+
+        std::vector<std::string> names, hashes;
+        for (std::size_t i = 0; i < users; ++i) {
+            names.push_back("user" + std::to_string(i));
+            hashes.push_back("hash" + std::to_string(i));
+        }
+
+        // Before: one handle, statement prepared on every call.
+        sqlite3* raw = nullptr;
+        sqlite3_open(kBenchDb, &raw);
+        std::mutex rawMutex;
+
+        bench::measure("authenticate, prepare per call (before)", iterations, [&](std::size_t i) {
+            authenticateUncached(raw, names[i % users], hashes[i % users]);
+        });
+        bench::measureParallel("authenticate, prepare per call, shared handle x" +
+                               std::to_string(threads) + " (before)",
+                               threads, iterations / threads, [&](unsigned, std::size_t i) {
+            std::lock_guard<std::mutex> lock(rawMutex);
+            authenticateUncached(raw, names[i % users], hashes[i % users]);
+        });
+        sqlite3_close(raw);
+
+        // After: cached statements on pooled read-only connections.
+        bench::measure("authenticate, cached statement (after)", iterations, [&](std::size_t i) {
+            db.authenticateUser(names[i % users], hashes[i % users]);
+        });
+        bench::measureParallel("authenticate, reader pool x" + std::to_string(threads) + " (after)",
+                               threads, iterations / threads, [&](unsigned, std::size_t i) {
+            db.authenticateUser(names[i % users], hashes[i % users]);
+        });
+
+        // I measure enqueue cost only; the writer batches in the background.
+        bench::measure("logQuery (write-behind enqueue)", iterations, [&](std::size_t i) {
+            db.logQuery(static_cast<int>(i % users) + 1, "Paris", "Weather in Paris");
+        });
+
+        // I read from a user with plenty of history so pages are full.
+        const std::size_t pages = 200;
+        bench::measure("getHistory, first page of 100", pages, [&](std::size_t) {
+            db.getHistory(1, 100);
+        });
+        bench::measure("forEachHistory, first page of 100 (no copies)", pages, [&](std::size_t) {
+            std::size_t bytes = 0;
+            db.forEachHistory(1, 100, HistoryCursor{}, [&bytes](const HistoryRowView& row) {
+                bytes += row.summary.size();
+            });
+        });
+    }
+    removeBenchFiles();
+}
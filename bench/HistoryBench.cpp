@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <string>
+
+#include <sqlite3.h>
+
+#include "Bench.h"
+#include "Database.h"
+
+// I use a separate scratch file from the database suite, since this one
+// takes a while to fill and the two can be run independently.
+static const char* kHistoryDb = "weather_history_bench.db";
+
+static void removeHistoryFiles() {
+    std::remove(kHistoryDb);
+    std::remove((std::string(kHistoryDb) + "-wal").c_str());
+    std::remove((std::string(kHistoryDb) + "-shm").c_str());
+}
+
+// I reproduce the query the way it ran before the history index existed:
+// NOT INDEXED forces the full scan and sort the old schema got.
+static std::size_t historyUnindexed(sqlite3* db, int userId, std::size_t limit) {
+    static const char* sql =
+        "SELECT id, timestamp, city, summary FROM query_logs NOT INDEXED "
+        "WHERE user_id = ? ORDER BY timestamp DESC, id DESC LIMIT ?;";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return 0;
+
+    sqlite3_bind_int(stmt, 1, userId);
+    sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(limit));
+
+    std::size_t rows = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) ++rows;
+    sqlite3_finalize(stmt);
+    return rows;
+}
+
+static void printPlan(sqlite3* db, const char* sql) {
+    sqlite3_stmt* stmt;
+    std::string explain = std::string("EXPLAIN QUERY PLAN ") + sql;
+    if (sqlite3_prepare_v2(db, explain.c_str(), -1, &stmt, nullptr) != SQLITE_OK) return;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        std::printf("    plan: %s\n", reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)));
+    }
+    sqlite3_finalize(stmt);
+}
+
+void runHistoryBench() {
+    const int users = 1000;
+    const int rows = 1000000;
+
+    removeHistoryFiles();
+
+    // I let Database create the schema, then bulk-load with one statement
+    // on a raw handle; going through logQuery would only time the writer.
+    { Database schema(kHistoryDb); }
+    {
+        sqlite3* raw = nullptr;
+        sqlite3_open(kHistoryDb, &raw);
+        std::string load =
+            "BEGIN;"
+            "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " +
+            std::to_string(users) + ") "
+            "INSERT INTO users (username, password) SELECT 'user' || i, 'hash' || i FROM n;"
+            "WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM n WHERE i < " +
+            std::to_string(rows - 1) + ") "
+            "INSERT INTO query_logs (user_id, city, summary, timestamp) "
+            "SELECT i % " + std::to_string(users) + " + 1, 'Paris', 'Weather in Paris: 18.0C', "
+            "datetime('2026-01-01', '+' || i || ' seconds') FROM n;"
+            "COMMIT;";
+        sqlite3_exec(raw, load.c_str(), nullptr, nullptr, nullptr);
+        std::printf("  loaded %d rows for %d users\n", rows, users);
+        sqlite3_close(raw);
+    }
+
+    {
+        // I reopen so startup runs ANALYZE over the loaded table, as it would
+        // on a long-running instance.
+        Database db(kHistoryDb);
+
+        sqlite3* raw = nullptr;
+        sqlite3_open_v2(kHistoryDb, &raw, SQLITE_OPEN_READONLY, nullptr);
+        printPlan(raw, "SELECT id, timestamp, city, summary FROM query_logs WHERE user_id = 1 "
+                       "ORDER BY timestamp DESC, id DESC LIMIT 100;");
+        printPlan(raw, "SELECT id, timestamp, city, summary FROM query_logs WHERE user_id = 1 "
+                       "AND (timestamp, id) < ('2026-01-06', 1) ORDER BY timestamp DESC, id DESC LIMIT 100;");
+
+        // Before: no usable index, so every page scans and sorts the table.
+        bench::measure("history, first page of 100, full scan (before)", 20, [&](std::size_t i) {
+            historyUnindexed(raw, static_cast<int>(i % users) + 1, 100);
+        });
+        sqlite3_close(raw);
+
+        // After: one index range scan in read order.
+        const std::size_t pages = 20000;
+        bench::measure("getHistory, first page of 100 (after)", pages, [&](std::size_t i) {
+            db.getHistory(static_cast<int>(i % users) + 1, 100);
+        });
+
+        // I start deep pages halfway through each user's history, where an
+        // OFFSET would have to walk past every earlier row.
+        HistoryCursor middle{ "2026-01-06 18:53:20", 500000 };
+        bench::measure("getHistory, page of 100 from the middle (after)", pages, [&](std::size_t i) {
+            db.getHistory(static_cast<int>(i % users) + 1, 100, middle);
+        });
+        bench::measure("forEachHistory, first page of 100 (after)", pages, [&](std::size_t i) {
+            std::size_t bytes = 0;
+            db.forEachHistory(static_cast<int>(i % users) + 1, 100, HistoryCursor{},
+                              [&bytes](const HistoryRowView& row) { bytes += row.summary.size(); });
+        });
+    }
+    removeHistoryFiles();
+}
@@ -0,0 +1,96 @@
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "Bench.h"
+#include "Database.h"
+#include "JsonWriter.h"
+#include "WeatherObservation.h"
+
+// I compare the two ways the server builds response bodies: an
+// nlohmann::json DOM and dump(), and appending straight to a string.
+void runJsonBench() {
+    const std::size_t iterations = 200000;
+    const std::size_t pages = 2000;
+
+    WeatherObservation observation;
+    observation.city = "Paris";
+    observation.tempC = 14.0;
+    observation.windKph = 11.2;
+    observation.humidity = 88;
+    observation.conditionCode = 1183;
+    observation.conditionText = "Light rain";
+    observation.observedAt = 1760611500;
+
+    std::size_t sink = 0;
+    bench::measure("weather response, nlohmann::json dump", iterations, [&](std::size_t) {
+        nlohmann::json body{
+            {"summary", observation.summary()},
+            {"observation", {
+                {"city", observation.city},
+                {"tempC", observation.tempC},
+                {"windKph", observation.windKph},
+                {"humidity", observation.humidity},
+                {"conditionCode", observation.conditionCode},
+                {"condition", observation.conditionText},
+                {"observedAt", observation.observedAt}
+            }}
+        };
+        sink += body.dump().size();
+    });
+    bench::measure("weather response, json_writer", iterations, [&](std::size_t) {
+        std::string out = "{";
+        json_writer::appendKey(out, "summary");
+        json_writer::appendString(out, observation.summary());
+        out += ",\"observation\":{";
+        json_writer::appendKey(out, "city");
+        json_writer::appendString(out, observation.city);
+        out += ",\"tempC\":";
+        json_writer::appendNumber(out, observation.tempC);
+        out += ",\"windKph\":";
+        json_writer::appendNumber(out, observation.windKph);
+        out += ",\"humidity\":";
+        json_writer::appendNumber(out, static_cast<long long>(observation.humidity));
+        out += ",\"conditionCode\":";
+        json_writer::appendNumber(out, static_cast<long long>(observation.conditionCode));
+        out += ",\"condition\":";
+        json_writer::appendString(out, observation.conditionText);
+        out += ",\"observedAt\":";
+        json_writer::appendNumber(out, static_cast<long long>(observation.observedAt));
+        out += "}}";
+        sink += out.size();
+    });
+
+    // I use a full default-sized /history page.
+    std::vector<HistoryRow> rows;
+    for (long long i = 0; i < 100; ++i) {
+        rows.push_back(HistoryRow{ i, "2025-10-16 12:45:00", "Paris",
+                                   "Weather in Paris | Temp 14.0 C | Wind 11.2 kph" });
+    }
+
+    bench::measure("history page (100 rows), nlohmann::json dump", pages, [&](std::size_t) {
+        nlohmann::json body = nlohmann::json::array();
+        for (const auto& row : rows) {
+            body.push_back({ {"timestamp", row.timestamp}, {"city", row.city}, {"summary", row.summary} });
+        }
+        sink += body.dump().size();
+    });
+    bench::measure("history page (100 rows), json_writer", pages, [&](std::size_t) {
+        std::string out = "[";
+        for (const auto& row : rows) {
+            if (out.size() > 1) out.push_back(',');
+            out += "{\"timestamp\":";
+            json_writer::appendString(out, row.timestamp);
+            out += ",\"city\":";
+            json_writer::appendString(out, row.city);
+            out += ",\"summary\":";
+            json_writer::appendString(out, row.summary);
+            out.push_back('}');
+        }
+        out.push_back(']');
+        sink += out.size();
+    });
+
+    if (sink == 1) std::printf("%zu\n", sink);
+}
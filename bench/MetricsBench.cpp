@@ -0,0 +1,30 @@
+#include <chrono>
+#include <string>
+
+#include "Bench.h"
+#include "Metrics.h"
+
+// I check that recording stays in the tens of nanoseconds, with and
+// without the two clock reads a ScopedLatency adds.
+void runMetricsBench() {
+    const std::size_t iterations = 5000000;
+    const unsigned threads = 4;
+
+    LatencyHistogram histogram;
+    bench::measure("LatencyHistogram::record", iterations, [&](std::size_t i) {
+        histogram.record(std::chrono::nanoseconds(1000 + (i & 0xFFFF) * 37));
+    });
+    bench::measureParallel("LatencyHistogram::record x" + std::to_string(threads),
+                           threads, iterations / threads, [&](unsigned, std::size_t i) {
+        histogram.record(std::chrono::nanoseconds(1000 + (i & 0xFFFF) * 37));
+    });
+    bench::measure("ScopedLatency (two clock reads + record)", iterations, [&](std::size_t) {
+        ScopedLatency timer(&histogram);
+    });
+
+    std::string out;
+    bench::measure("appendPrometheus (one series)", 10000, [&](std::size_t) {
+        out.clear();
+        histogram.appendPrometheus(out, "bench_duration_seconds", R"(route="/bench")");
+    });
+}
@@ -0,0 +1,91 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "Bench.h"
+#include "WeatherObservation.h"
+
+// I reproduce the old extractor (one find over the whole body per key)
+// so the single-pass parse has a baseline.
+static std::string extractByFind(const std::string& src, const std::string& key) {
+    auto pos = src.find(key);
+    if (pos == std::string::npos) return "N/A";
+    pos = src.find(':', pos);
+    if (pos == std::string::npos) return "N/A";
+    auto end = src.find_first_of(",}", pos + 1);
+    if (end == std::string::npos) end = src.size();
+
+    std::string raw = src.substr(pos + 1, end - pos - 1);
+    size_t start = raw.find_first_not_of(" \"\t");
+    size_t finish = raw.find_last_not_of(" \"\t");
+    if (start == std::string::npos || finish == std::string::npos) return "N/A";
+    return raw.substr(start, finish - start + 1);
+}
+
+// I load the upstream responses recorded under bench/data.
+static std::vector<std::string> loadPayloads() {
+    std::vector<std::string> payloads;
+    for (const auto& file : std::filesystem::directory_iterator(WEATHERAPP_BENCH_DATA)) {
+        if (file.path().extension() != ".json") continue;
+        std::ifstream in(file.path(), std::ios::binary);
+        std::ostringstream text;
+        text << in.rdbuf();
+        payloads.push_back(text.str());
+    }
+    return payloads;
+}
+
+void runParseBench() {
+    const std::size_t iterations = 200000;
+
+    std::vector<std::string> payloads = loadPayloads();
+    if (payloads.empty()) {
+        std::printf("  no payloads found in %s\n", WEATHERAPP_BENCH_DATA);
+        return;
+    }
+    const std::size_t count = payloads.size();
+    std::size_t sink = 0;
+
+    // Before: copy the body, find each key, format the summary eagerly.
+    bench::measure("copy + find per key + summary (before)", iterations, [&](std::size_t i) {
+        std::string body = payloads[i % count];
+        std::ostringstream out;
+        out << "Weather in Paris"
+            << " | Temp " << extractByFind(body, "\"temp_c\"")
+            << " C | Wind " << extractByFind(body, "\"wind_kph\"")
+            << " kph";
+        sink += out.str().size();
+    });
+
+    bench::measure("DOM parse (nlohmann::json::parse)", iterations, [&](std::size_t i) {
+        auto doc = nlohmann::json::parse(payloads[i % count]);
+        WeatherObservation observation;
+        observation.tempC = doc["current"]["temp_c"].get<double>();
+        observation.windKph = doc["current"]["wind_kph"].get<double>();
+        observation.humidity = doc["current"]["humidity"].get<int>();
+        observation.conditionCode = doc["current"]["condition"]["code"].get<int>();
+        observation.conditionText = doc["current"]["condition"]["text"].get<std::string>();
+        observation.observedAt = doc["current"]["last_updated_epoch"].get<std::int64_t>();
+        sink += static_cast<std::size_t>(observation.humidity);
+    });
+
+    bench::measure("SAX parse into WeatherObservation", iterations, [&](std::size_t i) {
+        WeatherObservation observation;
+        WeatherObservation::parse(payloads[i % count], observation);
+        sink += static_cast<std::size_t>(observation.humidity);
+    });
+
+    WeatherObservation cached;
+    WeatherObservation::parse(payloads.front(), cached);
+    cached.city = "Paris";
+    bench::measure("summary from a cached observation", iterations, [&](std::size_t) {
+        sink += cached.summary().size();
+    });
+
+    if (sink == 1) std::printf("%zu\n", sink);
+}
@@ -0,0 +1,81 @@
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <boost/beast/http.hpp>
+
+#include "Bench.h"
+#include "Router.h"
+
+namespace http = boost::beast::http;
+
+// I reproduce the old dispatch (one string compare per route, in
+// declaration order) so the table lookup has a baseline.
+static int dispatchByIfChain(http::verb method, std::string_view path) {
+    if (method == http::verb::options) return 0;
+    if (path == "/health") return 1;
+    if (path == "/auth/register" && method == http::verb::post) return 2;
+    if (path == "/auth/login" && method == http::verb::post) return 3;
+    if (path == "/auth/logout" && method == http::verb::post) return 4;
+    if (path == "/weather/current" && method == http::verb::post) return 5;
+    if (path == "/history" && method == http::verb::get) return 6;
+    if (path == "/stats/cache" && method == http::verb::get) return 7;
+    return -1;
+}
+
+static http::response<http::string_body> makeHealthResponse() {
+    http::response<http::string_body> res{http::status::ok, 11};
+    res.set(http::field::content_type, "application/json");
+    res.set(http::field::access_control_allow_origin, "*");
+    res.set(http::field::access_control_allow_headers, "Authorization, Content-Type");
+    res.set(http::field::access_control_allow_methods, "GET, POST, OPTIONS");
+    res.set(http::field::access_control_expose_headers, "X-Next-Cursor");
+    res.body() = R"({"status":"ok"})";
+    res.prepare_payload();
+    return res;
+}
+
+void runRouterBench() {
+    const std::size_t iterations = 2000000;
+
+    Router<int> router;
+    router.add(http::verb::get,  "/health", 1);
+    router.add(http::verb::post, "/auth/register", 2);
+    router.add(http::verb::post, "/auth/login", 3);
+    router.add(http::verb::post, "/auth/logout", 4);
+    router.add(http::verb::post, "/weather/current", 5);
+    router.add(http::verb::get,  "/history", 6);
+    router.add(http::verb::get,  "/stats/cache", 7);
+
+    // I cycle through a mix that includes the last route and a miss.
+    const std::string_view paths[] = { "/health", "/weather/current", "/stats/cache", "/nope" };
+    const http::verb verbs[] = { http::verb::get, http::verb::post, http::verb::get, http::verb::get };
+
+    // I expect these two to be close: the table is about structure (405s,
+    // path parameters), not speed. The /health rows below are the gain.
+    int sink = 0;
+    bench::measure("dispatch, if-chain (before)", iterations, [&](std::size_t i) {
+        sink += dispatchByIfChain(verbs[i % 4], paths[i % 4]);
+    });
+    bench::measure("dispatch, route table", iterations, [&](std::size_t i) {
+        int target = -1;
+        RouteParams params;
+        router.find(verbs[i % 4], paths[i % 4], target, params);
+        sink += target;
+    });
+
+    const std::size_t responses = 200000;
+    std::size_t bytes = 0;
+    bench::measure("/health, build + serialize per request (before)", responses, [&](std::size_t) {
+        std::ostringstream out;
+        out << makeHealthResponse();
+        bytes += out.str().size();
+    });
+
+    StaticResponse health(makeHealthResponse());
+    bench::measure("/health, pre-serialized", responses, [&](std::size_t i) {
+        bytes += health.bytes(11, i % 2 == 0).size();
+    });
+
+    if (sink == 42 && bytes == 0) std::printf("%d\n", sink);
+}
@@ -0,0 +1,38 @@
+#include <cstdio>
+#include <cstring>
+
+#include "Bench.h"
+
+// I register suites by name so a single one can be run in isolation:
+//   weather_bench            (everything)
+//   weather_bench database   (one suite)
+struct Suite {
+    const char* name;
+    void (*run)();
+};
+
+static const Suite kSuites[] = {
+    { "database", runDatabaseBench },
+    { "history",  runHistoryBench },
+    { "router",   runRouterBench },
+    { "parse",    runParseBench },
+    { "auth",     runAuthBench },
+    { "json",     runJsonBench },
+    { "metrics",  runMetricsBench },
+    { "compress", runCompressBench },
+    { "alloc",    runAllocBench },
+};
+
+int main(int argc, char* argv[]) {
+    for (const auto& suite : kSuites) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], suite.name) == 0) selected = true;
+        }
+        if (!selected) continue;
+
+        std::printf("[%s]\n", suite.name);
+        suite.run();
+    }
+    return bench::failures() == 0 ? 0 : 1;
+}
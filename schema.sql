@@ -1,8 +1,16 @@
+-- I describe the schema the server migrates every database to. The
+-- server applies it as numbered steps tracked in PRAGMA user_version
+-- (src/SchemaMigrations.cpp); a change here needs a new step there.
+
 -- I explicitly enable foreign key enforcement.
 -- SQLite does not enforce foreign keys by default, so this is required
 -- for ON DELETE CASCADE to actually work.
 PRAGMA foreign_keys = ON;
 
+-- I let retention hand freed pages back in small steps instead of
+-- rewriting the whole file. This must run before any table exists.
+PRAGMA auto_vacuum = INCREMENTAL;
+
 -- I store users separately to keep authentication concerns isolated.
 -- Usernames are unique, and passwords are stored as hashes (not plaintext).
 CREATE TABLE IF NOT EXISTS users (
@@ -23,8 +31,29 @@ CREATE TABLE IF NOT EXISTS query_logs (
     FOREIGN KEY (user_id) REFERENCES users(id) ON DELETE CASCADE
 );
 
--- I index user_id because history lookups are always user-scoped.
-CREATE INDEX IF NOT EXISTS idx_query_logs_user_id ON query_logs(user_id);
+-- I index history in the order it is read: always user-scoped, newest
+-- first, paged by (timestamp, id). A page is a range scan with no sort.
+CREATE INDEX IF NOT EXISTS idx_query_logs_history ON query_logs(user_id, timestamp DESC, id DESC);
 
--- I index timestamp to keep recent-history queries fast.
+-- I index timestamp so retention finds expired rows without a scan.
 CREATE INDEX IF NOT EXISTS idx_query_logs_timestamp ON query_logs(timestamp);
+
+-- I keep hourly per-city aggregates so statistics never scan query_logs.
+-- The server updates them in the same transaction as the logged rows;
+-- min/max stay NULL for hours with no successful reading.
+CREATE TABLE IF NOT EXISTS city_hourly (
+    city TEXT NOT NULL,
+    hour TEXT NOT NULL,
+    queries INTEGER NOT NULL,
+    readings INTEGER NOT NULL,
+    temp_min REAL,
+    temp_max REAL,
+    temp_sum REAL NOT NULL DEFAULT 0,
+    wind_min REAL,
+    wind_max REAL,
+    wind_sum REAL NOT NULL DEFAULT 0,
+    PRIMARY KEY (city, hour)
+) WITHOUT ROWID;
+
+-- I index hour so windowed statistics only touch recent rows.
+CREATE INDEX IF NOT EXISTS city_hourly_hour ON city_hourly(hour);
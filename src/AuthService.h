@@ -15,11 +15,12 @@ public:
     // and a negative value to signal failure.
     int loginUser(const std::string& username, const std::string& password);
 
+    // I centralize password hashing so it stays consistent everywhere.
+    // It needs no state, so benchmarks can call it directly.
+    static std::string hashPassword(const std::string& password);
+
 private:
     // I store a reference to the database instead of owning it
     // to keep lifetime management external.
     Database& db;
-
-    // I centralize password hashing so it stays consistent everywhere.
-    std::string hashPassword(const std::string& password);
 };
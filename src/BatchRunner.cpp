@@ -0,0 +1,147 @@
+#include "BatchRunner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "JsonWriter.h"
+
+BatchRunner::BatchRunner(WeatherCache& weatherCache, Database& database, const BatchOptions& opts)
+    : weather(weatherCache), db(database), options(opts) {
+    options.concurrency = std::max(1u, options.concurrency);
+    if (options.window == 0) options.window = 4 * static_cast<std::size_t>(options.concurrency);
+    options.window = std::max<std::size_t>(options.window, options.concurrency);
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+    return s;
+}
+
+BatchSummary BatchRunner::run(std::istream& in, std::ostream& out) {
+    struct Work {
+        std::uint64_t index;
+        std::uint64_t line;
+        std::string city;
+    };
+
+    // I park finished lines here until everything before them is out;
+    // index % window picks the slot, and the window keeps them apart.
+    struct Slot {
+        bool ready = false;
+        std::string json;
+    };
+
+    std::mutex mutex;
+    std::condition_variable workReady;
+    std::condition_variable spaceFree;
+    std::deque<Work> todo;
+    std::vector<Slot> slots(options.window);
+    std::uint64_t written = 0;
+    bool inputDone = false;
+    BatchSummary summary;
+
+    auto worker = [&] {
+        std::string json;
+        for (;;) {
+            Work work;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                workReady.wait(lock, [&] { return !todo.empty() || inputDone; });
+                if (todo.empty()) return;
+                work = std::move(todo.front());
+                todo.pop_front();
+            }
+
+            std::shared_ptr<const WeatherObservation> observation;
+            std::string error;
+            bool ok = false;
+            try {
+                ok = weather.getObservation(work.city, observation, error);
+            }
+            catch (const std::exception& e) {
+                error = std::string("Error: ") + e.what();
+            }
+            std::string text = ok ? observation->summary() : error;
+
+            // I serialize here, in parallel, so the lock only covers the write.
+            json = "{";
+            json_writer::appendKey(json, "line");
+            json_writer::appendNumber(json, static_cast<long long>(work.line));
+            json.push_back(',');
+            json_writer::appendKey(json, "city");
+            json_writer::appendString(json, work.city);
+            json.push_back(',');
+            json_writer::appendKey(json, "ok");
+            json += ok ? "true" : "false";
+            json.push_back(',');
+            json_writer::appendKey(json, ok ? "summary" : "error");
+            json_writer::appendString(json, text);
+            if (ok) {
+                json.push_back(',');
+                json_writer::appendKey(json, "observation");
+                observation->appendJson(json);
+            }
+            json += "}\n";
+
+            db.logQuery(options.userId, work.city, text, ok ? observation.get() : nullptr);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok) ++summary.ok;
+            else ++summary.failed;
+
+            if (options.completionOrder) {
+                out << json;
+                ++written;
+            } else {
+                Slot& slot = slots[work.index % slots.size()];
+                slot.json.swap(json);
+                slot.ready = true;
+                for (Slot* next = &slots[written % slots.size()]; next->ready;
+                     next = &slots[written % slots.size()]) {
+                    out << next->json;
+                    next->ready = false;
+                    ++written;
+                }
+            }
+            spaceFree.notify_one();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(options.concurrency);
+    for (unsigned i = 0; i < options.concurrency; ++i) threads.emplace_back(worker);
+
+    std::string text;
+    std::uint64_t index = 0;
+    std::uint64_t lineNumber = 0;
+    while (std::getline(in, text)) {
+        ++lineNumber;
+        std::string_view city = trim(text);
+        if (city.empty() || city.front() == '#') continue;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        spaceFree.wait(lock, [&] { return index - written < slots.size(); });
+        todo.push_back(Work{ index++, lineNumber, std::string(city) });
+        workReady.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inputDone = true;
+    }
+    workReady.notify_all();
+    for (auto& thread : threads) thread.join();
+
+    out.flush();
+    summary.cities = index;
+    return summary;
+}
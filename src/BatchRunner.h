@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+#include "Database.h"
+#include "WeatherCache.h"
+
+// I keep batch tunables together so main can fill them from flags.
+struct BatchOptions {
+    // I look up at most this many cities at once.
+    unsigned concurrency = 16;
+
+    // I write each result as soon as it is ready instead of in input order.
+    bool completionOrder = false;
+
+    // I read at most this many cities past the oldest one not yet
+    // written, which bounds memory however long the input is.
+    // Zero means four per concurrent lookup.
+    std::size_t window = 0;
+
+    // I log every lookup to query_logs under this user.
+    int userId = -1;
+};
+
+struct BatchSummary {
+    std::uint64_t cities = 0;
+    std::uint64_t ok = 0;
+    std::uint64_t failed = 0;
+};
+
+// I look up a list of cities for scripts: one city per line in, one JSON
+// object per city out (NDJSON). Lookups run on a fixed set of threads
+// through the shared cache, and every row goes through the query log
+// writer, which commits them in batched transactions. Memory stays
+// bounded by the window, not by the length of the input.
+class BatchRunner {
+public:
+    BatchRunner(WeatherCache& weather, Database& db, const BatchOptions& options = BatchOptions{});
+
+    // I skip blank lines and lines starting with '#'. Each output line is
+    // {"line":N,"city":...,"ok":true,"summary":...,"observation":{...}}
+    // or {"line":N,"city":...,"ok":false,"error":...}, N being the
+    // 1-based input line.
+    BatchSummary run(std::istream& in, std::ostream& out);
+
+private:
+    WeatherCache& weather;
+    Database& db;
+    BatchOptions options;
+};
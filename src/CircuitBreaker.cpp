@@ -0,0 +1,49 @@
+#include "CircuitBreaker.h"
+
+CircuitBreaker::CircuitBreaker(const CircuitBreakerOptions& opts) : options(opts) {}
+
+bool CircuitBreaker::allow() {
+    if (options.failureThreshold == 0) return true;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (current == State::open && Clock::now() >= reopenAt) current = State::halfOpen;
+
+    if (current == State::closed) return true;
+    if (current == State::halfOpen && !probing) {
+        probing = true;
+        return true;
+    }
+    rejections.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void CircuitBreaker::onSuccess() {
+    if (options.failureThreshold == 0) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    consecutiveFailures = 0;
+    probing = false;
+    current = State::closed;
+}
+
+void CircuitBreaker::onFailure() {
+    if (options.failureThreshold == 0) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    probing = false;
+
+    // I re-open straight away when the probe fails; closed, I wait for
+    // the threshold. Calls admitted before I opened may still report.
+    if (current == State::halfOpen || ++consecutiveFailures >= options.failureThreshold) {
+        if (current != State::open) opens.fetch_add(1, std::memory_order_relaxed);
+        current = State::open;
+        reopenAt = Clock::now() + options.openFor;
+        consecutiveFailures = 0;
+    }
+}
+
+CircuitBreaker::State CircuitBreaker::state() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (current == State::open && Clock::now() >= reopenAt) return State::halfOpen;
+    return current;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+struct CircuitBreakerOptions {
+    // I open after this many lookups in a row fail; zero disables me.
+    unsigned failureThreshold = 5;
+
+    // I stay open this long, then let a single probe through.
+    std::chrono::milliseconds openFor{10000};
+};
+
+// I stop calls to an upstream that keeps failing, so callers fail fast
+// (or fall back) instead of each waiting out a timeout. Closed, I let
+// everything through; open, nothing; half-open, one probe whose result
+// closes or re-opens me.
+class CircuitBreaker {
+public:
+    enum class State { closed, open, halfOpen };
+
+    explicit CircuitBreaker(const CircuitBreakerOptions& options = CircuitBreakerOptions{});
+
+    // I return false while open. Every true must be followed by exactly
+    // one onSuccess() or onFailure().
+    bool allow();
+    void onSuccess();
+    void onFailure();
+
+    State state() const;
+    std::uint64_t opened() const { return opens.load(std::memory_order_relaxed); }
+    std::uint64_t rejected() const { return rejections.load(std::memory_order_relaxed); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    CircuitBreakerOptions options;
+
+    // I am consulted once per upstream call, which costs far more than
+    // the lock, so a plain mutex keeps the transitions easy to follow.
+    mutable std::mutex mutex;
+    State current = State::closed;
+    unsigned consecutiveFailures = 0;
+    bool probing = false;
+    Clock::time_point reopenAt;
+
+    std::atomic<std::uint64_t> opens{0};
+    std::atomic<std::uint64_t> rejections{0};
+};
@@ -0,0 +1,20 @@
+#include "CityName.h"
+
+#include <cctype>
+
+std::string normalizeCity(std::string_view city) {
+    std::string key;
+    key.reserve(city.size());
+
+    bool pendingSpace = false;
+    for (unsigned char c : city) {
+        if (std::isspace(c)) {
+            pendingSpace = !key.empty();
+            continue;
+        }
+        if (pendingSpace) key.push_back(' ');
+        pendingSpace = false;
+        key.push_back(static_cast<char>(std::tolower(c)));
+    }
+    return key;
+}
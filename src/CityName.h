@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// I map a city name to the key everything that groups by city uses (the
+// weather cache, live streams and the hourly roll-ups): trimmed,
+// single-spaced and lower case, so "Paris", " paris " and "PARIS" are one.
+std::string normalizeCity(std::string_view city);
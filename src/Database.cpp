@@ -1,121 +1,575 @@
 #include "Database.h"
+#include <algorithm>
+#include <charconv>
 #include <stdexcept>
+#include <unordered_map>
+#include <zlib.h>
+
+#include "CityName.h"
+#include "JsonWriter.h"
+#include "SchemaMigrations.h"
+
+// I keep SQL text in named constants: the statement cache is keyed
+// by these pointers, so each one is prepared once per connection.
+static const char* const kInsertUser =
+    "INSERT INTO users (username, password) VALUES (?, ?);";
+static const char* const kSelectUser =
+    "SELECT id FROM users WHERE username = ? AND password = ?;";
+static const char* const kSelectUserId =
+    "SELECT id FROM users WHERE username = ?;";
+static const char* const kInsertQueryLog =
+    "INSERT INTO query_logs (user_id, city, summary) VALUES (?, ?, ?);";
+static const char* const kUpsertCityHour =
+    "INSERT INTO city_hourly (city, hour, queries, readings, temp_min, temp_max, temp_sum,"
+    " wind_min, wind_max, wind_sum) "
+    "VALUES (?, strftime('%Y-%m-%d %H:00:00', 'now'), ?, ?, ?, ?, ?, ?, ?, ?) "
+    "ON CONFLICT (city, hour) DO UPDATE SET "
+    "queries = queries + excluded.queries,"
+    "readings = readings + excluded.readings,"
+    "temp_min = min(coalesce(temp_min, excluded.temp_min), coalesce(excluded.temp_min, temp_min)),"
+    "temp_max = max(coalesce(temp_max, excluded.temp_max), coalesce(excluded.temp_max, temp_max)),"
+    "temp_sum = temp_sum + excluded.temp_sum,"
+    "wind_min = min(coalesce(wind_min, excluded.wind_min), coalesce(excluded.wind_min, wind_min)),"
+    "wind_max = max(coalesce(wind_max, excluded.wind_max), coalesce(excluded.wind_max, wind_max)),"
+    "wind_sum = wind_sum + excluded.wind_sum;";
+static const char* const kSelectTopCities =
+    "SELECT city, sum(queries), sum(readings), min(temp_min), max(temp_max), sum(temp_sum),"
+    " min(wind_min), max(wind_max), sum(wind_sum) "
+    "FROM city_hourly WHERE hour >= strftime('%Y-%m-%d %H:00:00', 'now', ?) "
+    "GROUP BY city ORDER BY sum(queries) DESC, city LIMIT ?;";
+static const char* const kSelectCityHours =
+    "SELECT city, hour, queries, readings, temp_min, temp_max, temp_sum,"
+    " wind_min, wind_max, wind_sum "
+    "FROM city_hourly WHERE city = ? AND hour >= strftime('%Y-%m-%d %H:00:00', 'now', ?) "
+    "ORDER BY hour;";
+static const char* const kAutoVacuumMode =
+    "PRAGMA auto_vacuum;";
+static const char* const kSelectExpiredLogs =
+    "SELECT id, user_id, timestamp, city, summary FROM query_logs "
+    "WHERE timestamp < strftime('%Y-%m-%d %H:%M:%S', 'now', ?) "
+    "ORDER BY timestamp, id LIMIT ?;";
+static const char* const kDeleteLogsUpTo =
+    "DELETE FROM query_logs WHERE (timestamp, id) <= (?, ?);";
+static const char* const kSelectLastLogId =
+    "SELECT id FROM query_logs WHERE user_id = ? "
+    "ORDER BY timestamp DESC, id DESC LIMIT 1;";
+static const char* const kSelectHistoryFirst =
+    "SELECT id, timestamp, city, summary FROM query_logs "
+    "WHERE user_id = ? "
+    "ORDER BY timestamp DESC, id DESC LIMIT ?;";
+static const char* const kSelectHistoryAfter =
+    "SELECT id, timestamp, city, summary FROM query_logs "
+    "WHERE user_id = ? AND (timestamp, id) < (?, ?) "
+    "ORDER BY timestamp DESC, id DESC LIMIT ?;";
+
+class Database::ReaderLease {
+public:
+    explicit ReaderLease(Database& database) : owner(database) {
+        if (owner.readers.empty()) {
+            // I share the writer (under its mutex) when there is no pool.
+            writerLock = std::unique_lock<std::mutex>(owner.mutex);
+            conn = owner.writer.get();
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(owner.readersMutex);
+        owner.readerAvailable.wait(lock, [this] { return !owner.idleReaders.empty(); });
+        conn = owner.idleReaders.back();
+        owner.idleReaders.pop_back();
+    }
+
+    ~ReaderLease() {
+        if (writerLock.owns_lock()) return;
+        {
+            std::lock_guard<std::mutex> lock(owner.readersMutex);
+            owner.idleReaders.push_back(conn);
+        }
+        owner.readerAvailable.notify_one();
+    }
+
+    SqliteConnection* operator->() const { return conn; }
+
+private:
+    Database& owner;
+    SqliteConnection* conn = nullptr;
+    std::unique_lock<std::mutex> writerLock;
+};
+
+// I apply the per-connection cache settings; each connection has its own.
+static void tune(SqliteConnection& conn, const DatabaseOptions& options) {
+    conn.execute("PRAGMA mmap_size=" + std::to_string(options.mmapBytes) + ";");
+    conn.execute("PRAGMA cache_size=-" + std::to_string(options.cacheKiB) + ";");
+    conn.execute("PRAGMA temp_store=MEMORY;");
+}
 
 // I open the database immediately so failure is explicit and fatal.
 // This keeps the rest of the application from running in a bad state.
-Database::Database(const std::string& filename) : db(nullptr) {
-    if (sqlite3_open(filename.c_str(), &db) != SQLITE_OK) {
-        throw std::runtime_error("Failed to open database");
-    }
-
-    // I create tables on startup so the application can run
-    // without requiring a separate migration step.
-    execute(
-        "CREATE TABLE IF NOT EXISTS users ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "username TEXT UNIQUE,"
-        "password TEXT);"
-    );
-
-    execute(
-        "CREATE TABLE IF NOT EXISTS query_logs ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "user_id INTEGER,"
-        "city TEXT,"
-        "summary TEXT,"
-        "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);"
-    );
+Database::Database(const std::string& filename, const DatabaseOptions& options) {
+    // I serialize writer access myself, so SQLite's own mutex is redundant.
+    writer = std::make_unique<SqliteConnection>(
+        filename, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX);
+
+    // I ask for incremental auto-vacuum first: it only takes effect on a
+    // database that has no tables yet, or after a VACUUM.
+    execute("PRAGMA auto_vacuum=INCREMENTAL;");
+
+    // I use WAL so readers never block on the log writer, and relax
+    // fsync to once per checkpoint, which is safe under WAL.
+    execute("PRAGMA journal_mode=WAL;");
+    execute("PRAGMA synchronous=NORMAL;");
+
+    tune(*writer, options);
+
+    // I bring the schema up to date before anything else touches it.
+    // Some steps rebuild tables, so foreign keys are enforced only after.
+    applyMigrations(*writer);
+    execute("PRAGMA foreign_keys=ON;");
+
+    // I refresh planner statistics on every start; the limit keeps this
+    // to a sample of each index, so it stays fast on a large log.
+    execute("PRAGMA analysis_limit=1000;");
+    execute("ANALYZE;");
+
+    // I convert an older database to incremental auto-vacuum once, with
+    // a full VACUUM, but only when retention will actually free pages.
+    retention = options.retention;
+    if (retention.maxAge.count() > 0) {
+        int mode = 0;
+        {
+            Statement stmt = writer->statement(kAutoVacuumMode);
+            if (stmt && sqlite3_step(stmt.get()) == SQLITE_ROW) mode = sqlite3_column_int(stmt.get(), 0);
+        }
+        if (mode != 2) execute("VACUUM;");
+    }
+
+    // I only pool readers for file databases; every connection to
+    // ":memory:" would see its own empty database.
+    bool inMemory = filename.empty() || filename == ":memory:" ||
+                    filename.rfind("file::memory:", 0) == 0;
+    if (!inMemory) {
+        for (std::size_t i = 0; i < options.readers; ++i) {
+            readers.push_back(std::make_unique<SqliteConnection>(
+                filename, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX));
+            tune(*readers.back(), options);
+            idleReaders.push_back(readers.back().get());
+        }
+    }
+
+    logWriter = std::make_unique<QueryLogWriter>(
+        [this](const std::vector<QueryLogEntry>& entries) { writeQueryLogs(entries); },
+        options.log);
+
+    if (retention.maxAge.count() > 0) {
+        pruner = std::make_unique<QueryLogPruner>(
+            [this] { return pruneQueryLogBatch(); },
+            [this] { compactQueryLogs(); },
+            retention);
+    }
 }
 
 // I close the database explicitly to avoid leaking resources.
 Database::~Database() {
-    if (db) sqlite3_close(db);
+    // I drain the log queue while the connection is still open.
+    pruner.reset();
+    logWriter.reset();
+    readers.clear();
+    writer.reset();
 }
 
 // I centralize raw SQL execution so error handling stays consistent.
 void Database::execute(const std::string& sql) {
-    char* err = nullptr;
-    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
-        std::string msg = err;
-        sqlite3_free(err);
-        throw std::runtime_error(msg);
-    }
+    writer->execute(sql);
 }
 
 // I insert users using prepared statements to avoid SQL injection
 // and to keep credential handling safe.
 bool Database::createUser(const std::string& username, const std::string& passwordHash) {
-    sqlite3_stmt* stmt;
-    const char* sql = "INSERT INTO users (username, password) VALUES (?, ?);";
+    ScopedLatency timer(&timings.createUser);
+    std::lock_guard<std::mutex> lock(mutex);
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
-        return false;
+    Statement stmt = writer->statement(kInsertUser);
+    if (!stmt) return false;
 
-    sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, passwordHash.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt.get(), 1, username.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt.get(), 2, passwordHash.c_str(), -1, SQLITE_TRANSIENT);
 
-    bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
-    return ok;
+    return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 // I authenticate by matching hashed credentials and returning
 // the user id instead of a boolean for downstream use.
 int Database::authenticateUser(const std::string& username, const std::string& passwordHash) {
-    sqlite3_stmt* stmt;
-    const char* sql = "SELECT id FROM users WHERE username = ? AND password = ?;";
+    ScopedLatency timer(&timings.authenticateUser);
+    ReaderLease reader(*this);
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
-        return -1;
+    Statement stmt = reader->statement(kSelectUser);
+    if (!stmt) return -1;
 
-    sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, passwordHash.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt.get(), 1, username.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt.get(), 2, passwordHash.c_str(), -1, SQLITE_TRANSIENT);
 
     int userId = -1;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        userId = sqlite3_column_int(stmt, 0);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        userId = sqlite3_column_int(stmt.get(), 0);
     }
+    return userId;
+}
+
+int Database::findUser(const std::string& username) {
+    ReaderLease reader(*this);
 
-    sqlite3_finalize(stmt);
+    Statement stmt = reader->statement(kSelectUserId);
+    if (!stmt) return -1;
+
+    sqlite3_bind_text(stmt.get(), 1, username.c_str(), -1, SQLITE_TRANSIENT);
+
+    int userId = -1;
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        userId = sqlite3_column_int(stmt.get(), 0);
+    }
     return userId;
 }
 
 // I log each weather query so history can be reconstructed later.
-// Failures here are intentionally ignored to avoid blocking the main flow.
-void Database::logQuery(int userId, const std::string& city, const std::string& summary) {
-    sqlite3_stmt* stmt;
-    const char* sql =
-        "INSERT INTO query_logs (user_id, city, summary) VALUES (?, ?, ?);";
+// The row is handed to the background writer; failures there are
+// intentionally ignored to avoid blocking the main flow.
+void Database::logQuery(int userId, const std::string& city, const std::string& summary,
+                        const WeatherObservation* reading) {
+    QueryLogEntry entry{ userId, city, summary };
+    if (reading) {
+        entry.hasReading = true;
+        entry.tempC = reading->tempC;
+        entry.windKph = reading->windKph;
+    }
+    versions.noteQueued(userId);
+    logWriter->enqueue(std::move(entry));
+}
+
+void Database::logQueries(std::vector<QueryLogEntry> entries) {
+    for (const auto& e : entries) versions.noteQueued(e.userId);
+    logWriter->enqueue(std::move(entries));
+}
+
+bool Database::historyVersion(int userId, HistoryVersion& out) {
+    switch (versions.lookup(userId, out)) {
+        case HistoryVersions::Lookup::known:   return true;
+        case HistoryVersions::Lookup::pending: return false;
+        case HistoryVersions::Lookup::unknown: break;
+    }
+
+    // I read the newest id once per user (one step down the history
+    // index); the writer keeps it current after that.
+    {
+        ReaderLease reader(*this);
+        Statement stmt = reader->statement(kSelectLastLogId);
+        if (!stmt) return false;
+
+        sqlite3_bind_int(stmt.get(), 1, userId);
+        int rc = sqlite3_step(stmt.get());
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) return false;
+        versions.seed(userId, rc == SQLITE_ROW ? sqlite3_column_int64(stmt.get(), 0) : 0);
+    }
+    return versions.lookup(userId, out) == HistoryVersions::Lookup::known;
+}
+
+void Database::writeQueryLogs(const std::vector<QueryLogEntry>& entries) {
+    ScopedLatency timer(&timings.writeQueryLogs);
 
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-    sqlite3_bind_int(stmt, 1, userId);
-    sqlite3_bind_text(stmt, 2, city.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, summary.c_str(), -1, SQLITE_TRANSIENT);
+    // I keep the rowid of every stored row (0 if it was not stored) and
+    // report them once committed, so history versions never run ahead
+    // of what readers can see.
+    std::vector<long long> ids(entries.size(), 0);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
 
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+        // I group the whole batch into one transaction (group commit). If
+        // it cannot begin, I drop the batch rather than let every insert
+        // autocommit and then report them as not stored.
+        Statement stmt = writer->statement(kInsertQueryLog);
+        if (stmt && sqlite3_exec(writer->handle(), "BEGIN;", nullptr, nullptr, nullptr) == SQLITE_OK) {
+            for (std::size_t i = 0; i < entries.size(); ++i) {
+                const auto& e = entries[i];
+                sqlite3_bind_int(stmt.get(), 1, e.userId);
+                sqlite3_bind_text(stmt.get(), 2, e.city.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt.get(), 3, e.summary.c_str(), -1, SQLITE_TRANSIENT);
+                if (sqlite3_step(stmt.get()) == SQLITE_DONE) {
+                    ids[i] = sqlite3_last_insert_rowid(writer->handle());
+                }
+                sqlite3_reset(stmt.get());
+            }
+            updateRollups(entries, ids);
+            if (sqlite3_exec(writer->handle(), "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+                sqlite3_exec(writer->handle(), "ROLLBACK;", nullptr, nullptr, nullptr);
+                std::fill(ids.begin(), ids.end(), 0);
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < entries.size(); ++i) versions.noteWritten(entries[i].userId, ids[i]);
+}
+
+void Database::updateRollups(const std::vector<QueryLogEntry>& entries,
+                             const std::vector<long long>& ids) {
+    // I fold the batch in memory first, so a batch costs one UPSERT per
+    // distinct city rather than one per row.
+    std::unordered_map<std::string, CityRollup> folded;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        // I only roll up rows that were stored, e.g. not those rejected by
+        // the foreign key because their user no longer exists.
+        if (ids[i] == 0) continue;
+        const auto& e = entries[i];
+        CityRollup& r = folded[normalizeCity(e.city)];
+        ++r.queries;
+        if (!e.hasReading) continue;
+
+        if (r.readings == 0) {
+            r.tempMin = r.tempMax = e.tempC;
+            r.windMin = r.windMax = e.windKph;
+        } else {
+            r.tempMin = std::min(r.tempMin, e.tempC);
+            r.tempMax = std::max(r.tempMax, e.tempC);
+            r.windMin = std::min(r.windMin, e.windKph);
+            r.windMax = std::max(r.windMax, e.windKph);
+        }
+        ++r.readings;
+        r.tempSum += e.tempC;
+        r.windSum += e.windKph;
+    }
+
+    Statement stmt = writer->statement(kUpsertCityHour);
+    if (!stmt) return;
+
+    for (const auto& entry : folded) {
+        const CityRollup& r = entry.second;
+        sqlite3_stmt* s = stmt.get();
+        sqlite3_bind_text(s, 1, entry.first.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(s, 2, r.queries);
+        sqlite3_bind_int64(s, 3, r.readings);
+        if (r.readings > 0) {
+            sqlite3_bind_double(s, 4, r.tempMin);
+            sqlite3_bind_double(s, 5, r.tempMax);
+            sqlite3_bind_double(s, 7, r.windMin);
+            sqlite3_bind_double(s, 8, r.windMax);
+        } else {
+            sqlite3_bind_null(s, 4);
+            sqlite3_bind_null(s, 5);
+            sqlite3_bind_null(s, 7);
+            sqlite3_bind_null(s, 8);
+        }
+        sqlite3_bind_double(s, 6, r.tempSum);
+        sqlite3_bind_double(s, 9, r.windSum);
+        sqlite3_step(s);
+        sqlite3_reset(s);
+    }
+}
+
+// I read a roll-up row laid out as city, [hour,] queries, readings,
+// temp min/max/sum, wind min/max/sum.
+static CityRollup readRollup(sqlite3_stmt* stmt, bool withHour) {
+    int c = 0;
+    CityRollup r;
+    r.city = reinterpret_cast<const char*>(sqlite3_column_text(stmt, c++));
+    if (withHour) r.hour = reinterpret_cast<const char*>(sqlite3_column_text(stmt, c++));
+    r.queries = sqlite3_column_int64(stmt, c++);
+    r.readings = sqlite3_column_int64(stmt, c++);
+    r.tempMin = sqlite3_column_double(stmt, c++);
+    r.tempMax = sqlite3_column_double(stmt, c++);
+    r.tempSum = sqlite3_column_double(stmt, c++);
+    r.windMin = sqlite3_column_double(stmt, c++);
+    r.windMax = sqlite3_column_double(stmt, c++);
+    r.windSum = sqlite3_column_double(stmt, c++);
+    return r;
+}
+
+// I express the window as an SQLite modifier relative to the current
+// hour, so "1 hour" means the current hour only.
+static std::string windowModifier(std::size_t hours) {
+    return "-" + std::to_string(hours > 0 ? hours - 1 : 0) + " hours";
+}
+
+std::vector<CityRollup> Database::topCities(std::size_t hours, std::size_t limit) {
+    ScopedLatency timer(&timings.readRollups);
+    ReaderLease reader(*this);
+
+    std::vector<CityRollup> rows;
+    Statement stmt = reader->statement(kSelectTopCities);
+    if (!stmt) return rows;
+
+    std::string window = windowModifier(hours);
+    sqlite3_bind_text(stmt.get(), 1, window.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(limit));
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) rows.push_back(readRollup(stmt.get(), false));
+    return rows;
+}
+
+std::vector<CityRollup> Database::cityHours(const std::string& city, std::size_t hours) {
+    ScopedLatency timer(&timings.readRollups);
+    ReaderLease reader(*this);
+
+    std::vector<CityRollup> rows;
+    Statement stmt = reader->statement(kSelectCityHours);
+    if (!stmt) return rows;
+
+    std::string key = normalizeCity(city);
+    std::string window = windowModifier(hours);
+    sqlite3_bind_text(stmt.get(), 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt.get(), 2, window.c_str(), -1, SQLITE_TRANSIENT);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) rows.push_back(readRollup(stmt.get(), true));
+    return rows;
+}
+
+static std::string_view columnText(sqlite3_stmt* stmt, int column) {
+    const unsigned char* text = sqlite3_column_text(stmt, column);
+    if (!text) return {};
+    return { reinterpret_cast<const char*>(text),
+             static_cast<std::size_t>(sqlite3_column_bytes(stmt, column)) };
+}
+
+// I append rows to a gzip archive as one member per batch. gzip readers
+// treat concatenated members as one stream, and closing the member before
+// the rows are deleted means a crash can only duplicate, never lose, them.
+static bool appendToArchive(const std::string& path, const std::string& lines) {
+    gzFile file = gzopen(path.c_str(), "ab");
+    if (!file) return false;
+
+    bool ok = gzwrite(file, lines.data(), static_cast<unsigned>(lines.size())) ==
+              static_cast<int>(lines.size());
+    return gzclose(file) == Z_OK && ok;
+}
+
+std::size_t Database::pruneQueryLogBatch() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Statement select = writer->statement(kSelectExpiredLogs);
+    Statement remove = writer->statement(kDeleteLogsUpTo);
+    if (!select || !remove) return 0;
+
+    std::string age = "-" + std::to_string(retention.maxAge.count()) + " seconds";
+    sqlite3_bind_text(select.get(), 1, age.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(select.get(), 2, static_cast<sqlite3_int64>(retention.batchSize));
+
+    // I remember the newest key in the batch; everything up to it is
+    // expired, since rows are selected oldest first.
+    bool archive = !retention.archivePath.empty();
+    std::string lines;
+    std::string lastTimestamp;
+    long long lastId = 0;
+    std::size_t count = 0;
+    while (sqlite3_step(select.get()) == SQLITE_ROW) {
+        lastId = sqlite3_column_int64(select.get(), 0);
+        lastTimestamp = std::string(columnText(select.get(), 2));
+        ++count;
+        if (!archive) continue;
+
+        lines.push_back('{');
+        json_writer::appendKey(lines, "id");
+        json_writer::appendNumber(lines, lastId);
+        lines.push_back(',');
+        json_writer::appendKey(lines, "userId");
+        json_writer::appendNumber(lines, static_cast<long long>(sqlite3_column_int64(select.get(), 1)));
+        lines.push_back(',');
+        json_writer::appendKey(lines, "timestamp");
+        json_writer::appendString(lines, lastTimestamp);
+        lines.push_back(',');
+        json_writer::appendKey(lines, "city");
+        json_writer::appendString(lines, columnText(select.get(), 3));
+        lines.push_back(',');
+        json_writer::appendKey(lines, "summary");
+        json_writer::appendString(lines, columnText(select.get(), 4));
+        lines += "}\n";
+    }
+    if (count == 0) return 0;
+
+    // I keep the rows when the archive cannot be written; the next
+    // pass tries again.
+    if (archive && !appendToArchive(retention.archivePath, lines)) return 0;
+
+    ScopedLatency timer(&timings.pruneQueryLogs);
+    sqlite3_bind_text(remove.get(), 1, lastTimestamp.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(remove.get(), 2, lastId);
+    if (sqlite3_step(remove.get()) != SQLITE_DONE) return 0;
+
+    std::size_t deleted = static_cast<std::size_t>(sqlite3_changes(writer->handle()));
+    if (deleted > 0) versions.notePruned();
+    timings.prunedRows.fetch_add(deleted, std::memory_order_relaxed);
+    return deleted;
+}
+
+void Database::compactQueryLogs() {
+    std::lock_guard<std::mutex> lock(mutex);
+    execute("PRAGMA incremental_vacuum(" + std::to_string(retention.vacuumPages) + ");");
+}
+
+std::string HistoryCursor::toString() const {
+    return timestamp + "|" + std::to_string(id);
+}
+
+bool HistoryCursor::parse(std::string_view text, HistoryCursor& out) {
+    auto bar = text.rfind('|');
+    if (bar == std::string_view::npos || bar == 0 || bar + 1 == text.size()) return false;
+
+    // I reject signs, trailing junk and ids that do not fit, since the
+    // text comes straight from the client.
+    std::string_view digits = text.substr(bar + 1);
+    if (digits.front() < '0' || digits.front() > '9') return false;
+    long long id = 0;
+    auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), id);
+    if (ec != std::errc{} || end != digits.data() + digits.size()) return false;
+
+    out.timestamp.assign(text.data(), bar);
+    out.id = id;
+    return true;
 }
 
 // I return history ordered by most recent first since that’s
-// the only way it’s consumed by the UI.
-std::vector<HistoryRow> Database::getHistory(int userId) {
-    sqlite3_stmt* stmt;
-    const char* sql =
-        "SELECT timestamp, city, summary FROM query_logs "
-        "WHERE user_id = ? ORDER BY timestamp DESC;";
+// the only way it’s consumed by the UI. The id breaks ties between
+// rows logged within the same second.
+std::size_t Database::forEachHistory(int userId, std::size_t limit, const HistoryCursor& before,
+                                     const std::function<void(const HistoryRowView&)>& fn) {
+    ScopedLatency timer(&timings.forEachHistory);
+    ReaderLease reader(*this);
 
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-    sqlite3_bind_int(stmt, 1, userId);
+    Statement stmt = reader->statement(before.empty() ? kSelectHistoryFirst : kSelectHistoryAfter);
+    if (!stmt) return 0;
 
-    std::vector<HistoryRow> rows;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        HistoryRow r;
-        r.timestamp = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        r.city      = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        r.summary   = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        rows.push_back(r);
+    int param = 1;
+    sqlite3_bind_int(stmt.get(), param++, userId);
+    if (!before.empty()) {
+        sqlite3_bind_text(stmt.get(), param++, before.timestamp.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt.get(), param++, before.id);
     }
+    sqlite3_bind_int64(stmt.get(), param, static_cast<sqlite3_int64>(limit));
 
-    sqlite3_finalize(stmt);
+    std::size_t count = 0;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        HistoryRowView row{
+            sqlite3_column_int64(stmt.get(), 0),
+            columnText(stmt.get(), 1),
+            columnText(stmt.get(), 2),
+            columnText(stmt.get(), 3)
+        };
+        fn(row);
+        ++count;
+    }
+    return count;
+}
+
+// I flush the whole queue, but only for a user with rows in it, so a
+// history read under heavy logging does not turn group commit into one
+// commit per page.
+void Database::flushHistory(int userId) {
+    HistoryVersion version;
+    if (versions.lookup(userId, version) == HistoryVersions::Lookup::pending) logWriter->flush();
+}
+
+std::vector<HistoryRow> Database::getHistory(int userId, std::size_t limit,
+                                             const HistoryCursor& before) {
+    flushHistory(userId);
+    std::vector<HistoryRow> rows;
+    forEachHistory(userId, limit, before, [&rows](const HistoryRowView& r) {
+        rows.push_back(HistoryRow{
+            r.id, std::string(r.timestamp), std::string(r.city), std::string(r.summary)
+        });
+    });
     return rows;
 }
@@ -1,34 +1,199 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <functional>
 #include <vector>
-#include <sqlite3.h>
+#include <mutex>
+#include <memory>
+#include <condition_variable>
+
+#include "HistoryVersions.h"
+#include "Metrics.h"
+#include "QueryLogPruner.h"
+#include "QueryLogWriter.h"
+#include "SqliteConnection.h"
+#include "WeatherObservation.h"
 
 // I use a simple data struct to move history rows
 // between the database layer and the rest of the app.
 struct HistoryRow {
+    long long id;
     std::string timestamp;
     std::string city;
     std::string summary;
 };
 
+// I hand streamed rows out as views into SQLite's own buffers; they are
+// only valid for the duration of the callback.
+struct HistoryRowView {
+    long long id;
+    std::string_view timestamp;
+    std::string_view city;
+    std::string_view summary;
+};
+
+// I page history by keyset (timestamp, id) rather than OFFSET, so every
+// page costs the same no matter how deep into the history it is.
+struct HistoryCursor {
+    std::string timestamp;
+    long long id = 0;
+
+    bool empty() const { return timestamp.empty(); }
+
+    // I encode the cursor as "<timestamp>|<id>" for use in URLs.
+    std::string toString() const;
+    static bool parse(std::string_view text, HistoryCursor& out);
+};
+
+// I hold one city's roll-up, either for a single hour or summed over
+// a window (then hour is empty). The min/max fields are only meaningful
+// when readings > 0.
+struct CityRollup {
+    std::string city;
+    std::string hour;
+    long long queries = 0;
+    long long readings = 0;
+    double tempMin = 0.0;
+    double tempMax = 0.0;
+    double tempSum = 0.0;
+    double windMin = 0.0;
+    double windMax = 0.0;
+    double windSum = 0.0;
+};
+
+// I keep database tunables together so main can pass them as one value.
+struct DatabaseOptions {
+    // I open this many read-only connections so lookups from several
+    // server threads run in parallel with each other and with writes.
+    // In-memory databases cannot share connections and use none.
+    std::size_t readers = 4;
+
+    // I give every connection this much memory-mapped I/O and page
+    // cache, so hot history pages are read without syscalls.
+    std::size_t mmapBytes = 256u * 1024 * 1024;
+    std::size_t cacheKiB = 16 * 1024;
+
+    QueryLogOptions log;
+    QueryLogRetention retention;
+};
+
+// I time every method that touches SQLite, so /metrics can show
+// where database time goes.
+struct DatabaseMetrics {
+    LatencyHistogram createUser;
+    LatencyHistogram authenticateUser;
+    LatencyHistogram forEachHistory;    // getHistory goes through it too
+    LatencyHistogram writeQueryLogs;    // one sample per batch transaction
+    LatencyHistogram readRollups;
+    LatencyHistogram pruneQueryLogs;    // one sample per deleted batch
+
+    std::atomic<std::uint64_t> prunedRows{0};
+};
+
 class Database {
 public:
     // I require the database filename at construction
     // so the connection is always valid after creation.
-    Database(const std::string& filename);
+    Database(const std::string& filename, const DatabaseOptions& options = DatabaseOptions{});
+
+    // I flush pending query logs before closing the connections.
     ~Database();
 
     // I expose only high-level operations instead of raw SQL.
     bool createUser(const std::string& username, const std::string& passwordHash);
     int authenticateUser(const std::string& username, const std::string& passwordHash);
 
-    void logQuery(int userId, const std::string& city, const std::string& summary);
-    std::vector<HistoryRow> getHistory(int userId);
+    // I return a user's id without checking credentials, or -1, for
+    // tools that act on a user's behalf (batch mode).
+    int findUser(const std::string& username);
+
+    // I queue the row for the background writer and return immediately,
+    // so logging never adds SQLite latency to a request.
+    // The reading, when given, also feeds the hourly per-city roll-ups.
+    void logQuery(int userId, const std::string& city, const std::string& summary,
+                  const WeatherObservation* reading = nullptr);
+
+    // I queue several rows that must be committed together.
+    void logQueries(std::vector<QueryLogEntry> entries);
+
+    // I return up to `limit` rows older than `before` (newest first).
+    // Pending query logs are flushed first so callers see their own writes.
+    std::vector<HistoryRow> getHistory(int userId, std::size_t limit,
+                                       const HistoryCursor& before = HistoryCursor{});
+
+    // I stream the same page straight from the SQLite cursor into fn
+    // without copying rows, and return how many rows were visited.
+    // I do not flush; call flushHistory first to see your own writes.
+    std::size_t forEachHistory(int userId, std::size_t limit, const HistoryCursor& before,
+                               const std::function<void(const HistoryRowView&)>& fn);
+
+    // I wait until the user's queued query logs are written, so a read
+    // that follows sees them. Only a hash lookup when none are queued.
+    void flushHistory(int userId);
+
+    // I report the current version of a user's history without reading
+    // it, for ETags. False means rows are still queued, so the caller
+    // must read the history (which flushes them) to know what it holds.
+    // After the first call per user this is a hash lookup.
+    bool historyVersion(int userId, HistoryVersion& out);
+
+    // I answer from the hourly roll-ups, so cost follows the number of
+    // cities and hours involved, not the size of query_logs. Hours are
+    // UTC "YYYY-MM-DD HH:00:00" like query_logs.timestamp. Rows still
+    // queued for the writer are not included yet.
+
+    // I return the most-queried cities of the last `hours` hours.
+    std::vector<CityRollup> topCities(std::size_t hours, std::size_t limit);
+
+    // I return one city's hourly rows for the last `hours` hours, oldest first.
+    std::vector<CityRollup> cityHours(const std::string& city, std::size_t hours);
+
+    const DatabaseMetrics& metrics() const { return timings; }
 
 private:
-    // I keep the raw SQLite handle private to avoid leaking DB concerns.
-    sqlite3* db;
+    // I check a reader out of the pool for the lifetime of one call
+    // and fall back to the writer when there are no readers.
+    class ReaderLease;
+
+    // I keep the raw SQLite handles private to avoid leaking DB concerns.
+    // All writes go through this single connection (WAL allows one writer).
+    std::unique_ptr<SqliteConnection> writer;
+
+    // I serialize access to the writer because the server
+    // calls into the database from several worker threads.
+    std::mutex mutex;
+
+    std::vector<std::unique_ptr<SqliteConnection>> readers;
+    std::vector<SqliteConnection*> idleReaders;
+    std::mutex readersMutex;
+    std::condition_variable readerAvailable;
 
     // I centralize raw SQL execution to keep error handling consistent.
     void execute(const std::string& sql);
+
+    // I write one batch of queued logs inside a single transaction,
+    // so a whole batch costs one fsync instead of one per row.
+    void writeQueryLogs(const std::vector<QueryLogEntry>& entries);
+
+    // I add the stored rows of a batch (non-zero ids) to the hourly
+    // per-city roll-ups, inside its transaction.
+    void updateRollups(const std::vector<QueryLogEntry>& entries, const std::vector<long long>& ids);
+
+    // I delete (and archive, if configured) one batch of the oldest rows
+    // past the retention age and return how many went.
+    std::size_t pruneQueryLogBatch();
+
+    // I hand free pages left behind by pruning back to the file system.
+    void compactQueryLogs();
+
+    QueryLogRetention retention;
+
+    DatabaseMetrics timings;
+    HistoryVersions versions;
+
+    // I start last and stop first, since the writer uses the handle above.
+    std::unique_ptr<QueryLogWriter> logWriter;
+
+    // I only exist when a retention age is set, and stop before the writer.
+    std::unique_ptr<QueryLogPruner> pruner;
 };
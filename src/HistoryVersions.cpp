@@ -0,0 +1,41 @@
+#include "HistoryVersions.h"
+
+#include <algorithm>
+
+void HistoryVersions::noteQueued(int userId, std::size_t rows) {
+    Shard& shard = shardFor(userId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.users[userId].pending += rows;
+}
+
+void HistoryVersions::noteWritten(int userId, long long id) {
+    Shard& shard = shardFor(userId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry& entry = shard.users[userId];
+    if (entry.pending > 0) --entry.pending;
+    if (id > 0) {
+        entry.lastId = std::max(entry.lastId, id);
+        entry.known = true;
+    }
+}
+
+void HistoryVersions::seed(int userId, long long lastId) {
+    Shard& shard = shardFor(userId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry& entry = shard.users[userId];
+    entry.lastId = std::max(entry.lastId, lastId);
+    entry.known = true;
+}
+
+HistoryVersions::Lookup HistoryVersions::lookup(int userId, HistoryVersion& out) const {
+    const Shard& shard = shardFor(userId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.users.find(userId);
+    if (it == shard.users.end()) return Lookup::unknown;
+    if (it->second.pending > 0) return Lookup::pending;
+    if (!it->second.known) return Lookup::unknown;
+
+    out.lastId = it->second.lastId;
+    out.pruned = pruned.load(std::memory_order_relaxed);
+    return Lookup::known;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// I identify the state of one user's history: the id of their newest
+// query_logs row and how many times retention has deleted rows since
+// start. Either changing means a page may have changed.
+struct HistoryVersion {
+    long long lastId = 0;
+    std::uint64_t pruned = 0;
+};
+
+// I track HistoryVersion per user in memory so a conditional /history
+// request is answered from one hash lookup. The log writer reports what
+// it queued and wrote; a user with queued rows has no usable version
+// until they are written.
+class HistoryVersions {
+public:
+    // I count rows handed to the log writer but not yet written.
+    void noteQueued(int userId, std::size_t rows = 1);
+
+    // I record one row leaving the queue; id is its rowid, or 0 if the
+    // insert failed. Ids only grow, so the newest written is the newest.
+    void noteWritten(int userId, long long id);
+
+    // I seed a user's version from the database the first time it is
+    // asked for; a version learned from the writer meanwhile wins.
+    void seed(int userId, long long lastId);
+
+    // I note that retention deleted rows, which changes old pages.
+    void notePruned() { pruned.fetch_add(1, std::memory_order_relaxed); }
+
+    enum class Lookup { known, pending, unknown };
+
+    // I report whether out is current (known), rows are still queued
+    // (pending), or the user has not been seeded yet (unknown).
+    Lookup lookup(int userId, HistoryVersion& out) const;
+
+private:
+    static constexpr std::size_t kShardCount = 16;
+
+    struct Entry {
+        long long lastId = 0;
+        std::size_t pending = 0;
+        bool known = false;
+    };
+
+    // I shard like the session store, so users rarely share a lock.
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<int, Entry> users;
+    };
+
+    Shard& shardFor(int userId) { return shards[static_cast<unsigned>(userId) % kShardCount]; }
+    const Shard& shardFor(int userId) const { return shards[static_cast<unsigned>(userId) % kShardCount]; }
+
+    Shard shards[kShardCount];
+    std::atomic<std::uint64_t> pruned{0};
+};
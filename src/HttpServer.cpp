@@ -4,145 +4,1647 @@
 // and dependency-free.
 #include <iostream>
 
-#include <boost/beast/core.hpp>
-#include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
-#include <boost/asio.hpp>
 #include <nlohmann/json.hpp>
+#include "CityName.h"
+#include "JsonWriter.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <optional>
+#include <tuple>
+#include <thread>
 #include <vector>
 #include <utility>
 
-#include "WeatherClient.h"
-
-using tcp = boost::asio::ip::tcp;
+namespace net = boost::asio;
+namespace beast = boost::beast;
 namespace http = boost::beast::http;
+using tcp = boost::asio::ip::tcp;
+
+// I name the strand type instead of using beast::tcp_stream: its
+// type-erased executor allocates whenever it copies a strand, which
+// Asio and Beast do several times per request.
+using ConnectionStrand = net::strand<net::io_context::executor_type>;
+using ConnectionSocket = net::basic_stream_socket<tcp, ConnectionStrand>;
+using ConnectionTimer = net::basic_waitable_timer<std::chrono::steady_clock,
+                                                  net::wait_traits<std::chrono::steady_clock>, ConnectionStrand>;
+
+// I bound every socket operation so a stalled peer cannot pin
+// a connection (and its memory) forever.
+static constexpr std::chrono::seconds kSocketTimeout{30};
+
+// I let asio allocate a handler's operation state from a request arena
+// instead of the heap; asio and Beast look for allocator_type.
+template <class Handler>
+class ArenaHandler {
+public:
+    using allocator_type = ArenaAllocator;
+
+    ArenaHandler(ArenaAllocator alloc, Handler h) : allocator(alloc), handler(std::move(h)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator; }
+
+    template <class... Args>
+    void operator()(Args&&... args) { handler(std::forward<Args>(args)...); }
+
+private:
+    ArenaAllocator allocator;
+    Handler handler;
+};
+
+template <class Handler>
+static ArenaHandler<std::decay_t<Handler>> inArena(RequestArena& arena, Handler&& handler) {
+    return { arena.allocator(), std::forward<Handler>(handler) };
+}
+
+static unsigned resolveIoThreads(const ServerOptions& options) {
+    if (options.ioThreads > 0) return options.ioThreads;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+static unsigned resolveWorkerThreads(const ServerOptions& options) {
+    if (options.workerThreads > 0) return options.workerThreads;
+    return resolveIoThreads(options) * 4;
+}
+
+// I model one accepted socket as a chain of async callbacks.
+// The connection keeps itself alive through shared_from_this()
+// and all of its callbacks run on its own strand.
+//
+// Requests are read back to back (pipelining) while earlier ones are
+// still being handled; each gets a slot in a FIFO so responses always
+// leave in request order even when handlers finish out of order.
+//
+// Each slot owns a RequestArena that holds the parsed request, its reply
+// and the asio operations in between. A slot is recycled once its
+// response is written, so a keep-alive connection parses, handles and
+// answers requests without touching the heap.
+//
+// A connection whose reply subscribes to a stream stays on it for good:
+// events from the hub are queued and written as chunks, and a client that
+// falls streamQueueLimit events behind is disconnected.
+class HttpServer::Connection : public std::enable_shared_from_this<Connection>,
+                               public StreamSubscriber {
+public:
+    Connection(HttpServer& owner, ConnectionSocket&& socket)
+        : server(owner), stream(std::move(socket)), timer(stream.get_executor()) {
+        // I read the peer address once; rate limits key on it per request.
+        beast::error_code ec;
+        auto peer = stream.remote_endpoint(ec);
+        if (!ec) clientAddress = peer.address().to_string();
+        server.openConnections.fetch_add(1, std::memory_order_relaxed);
+        server.acceptedConnections.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~Connection() {
+        server.openConnections.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void start() {
+        // I hop onto the connection's strand before touching the stream.
+        net::dispatch(stream.get_executor(),
+                      beast::bind_front_handler(&Connection::onStart, shared_from_this()));
+    }
+
+    // I am called by the hub from any thread, so I only hop to my strand.
+    void deliver(const std::shared_ptr<const std::string>& event) override {
+        net::post(stream.get_executor(), [self = shared_from_this(), event] {
+            self->queueEvent(event);
+        });
+    }
+
+private:
+    using RequestParser = http::request_parser<ArenaStringBody, ArenaAllocator>;
+
+    // I hold one in-flight request and its response; ready flips once its
+    // handler is done. Fixed responses are pre-serialized bytes in raw
+    // instead of a reply. Streaming replies also keep their header
+    // serializer and the one chunk buffer that is refilled for every write.
+    struct Slot {
+        // I come first so I outlive everything allocated from me.
+        RequestArena arena;
+        std::optional<RequestParser> parser;
+        std::optional<Reply> reply;
+        std::string_view raw;
+        bool keepAlive = true;
+        bool ready = false;
+
+        std::unique_ptr<http::response<http::empty_body>> head;
+        std::unique_ptr<http::response_serializer<http::empty_body>> serializer;
+        std::string chunk;
+        bool streamDone = false;
+
+        // I am non-zero when this request is sampled for tracing.
+        std::uint64_t traceId = 0;
+        std::int64_t writeStarted = 0;
+
+        Request& request() { return parser->get(); }
+
+        // I get ready to read a request into the arena, emptied first.
+        void begin() {
+            reply.reset();
+            parser.reset();
+            raw = {};
+            keepAlive = true;
+            ready = false;
+            head.reset();
+            serializer.reset();
+            chunk.clear();
+            streamDone = false;
+            traceId = 0;
+            writeStarted = 0;
+
+            arena.reset();
+            ArenaAllocator alloc = arena.allocator();
+            parser.emplace(std::piecewise_construct, std::make_tuple(alloc), std::make_tuple(alloc));
+        }
+    };
+
+    // I reuse a finished slot, and the memory its arena kept, when I can.
+    std::shared_ptr<Slot> takeSlot() {
+        std::shared_ptr<Slot> slot;
+        if (spareSlots.empty()) {
+            slot = std::make_shared<Slot>();
+        } else {
+            slot = std::move(spareSlots.back());
+            spareSlots.pop_back();
+        }
+        slot->begin();
+        return slot;
+    }
+
+    void onStart() {
+        doRead();
+        waitForDeadline();
+    }
+
+    // I use the idle timeout only when nothing is outstanding,
+    // otherwise the shorter per-operation timeout applies.
+    void armTimer() {
+        setDeadline(slots.empty() ? server.options.idleTimeout : kSocketTimeout);
+    }
+
+    // I time out with one timer per connection instead of Beast's
+    // per-operation ones, which allocate on every read and write. Moving
+    // the deadline only stores it; the timer is re-armed when it fires
+    // early, or cut short when the deadline comes closer.
+    void setDeadline(std::chrono::steady_clock::duration timeout) {
+        deadline = std::chrono::steady_clock::now() + timeout;
+        if (deadline < timer.expiry()) timer.expires_at(deadline);
+    }
+
+    void clearDeadline() {
+        deadline = std::chrono::steady_clock::time_point::max();
+    }
+
+    // I only hold the connection weakly so a pending wait never keeps a
+    // finished connection alive.
+    void waitForDeadline() {
+        timer.expires_at(deadline);
+        timer.async_wait([weak = weak_from_this()](beast::error_code) {
+            if (auto self = weak.lock()) self->onDeadline();
+        });
+    }
+
+    void onDeadline() {
+        if (!stream.is_open()) return;
+        if (std::chrono::steady_clock::now() < deadline) return waitForDeadline();
+
+        // I close the socket so whatever is pending fails, as a timeout.
+        beast::error_code ec;
+        stream.close(ec);
+    }
+
+    void doRead() {
+        // I pause reading when too many requests are queued; onWrite resumes.
+        if (reading || closing || slots.size() >= server.options.pipelineLimit) return;
+
+        reading = true;
+        if (!incoming) incoming = takeSlot();
+        armTimer();
+
+        // I only read the clock when a sampled request may need it.
+        readStarted = Tracer::instance().enabled() ? Tracer::nowNanos() : 0;
+        // I reuse the same buffer across requests so pipelined bytes that
+        // arrived with the previous request are parsed without a new read.
+        http::async_read(stream, buffer, *incoming->parser,
+                         inArena(incoming->arena,
+                                 beast::bind_front_handler(&Connection::onRead, shared_from_this())));
+    }
+
+    void onRead(beast::error_code ec, std::size_t) {
+        reading = false;
+
+        // I expect nothing from an event stream client but its hang-up.
+        if (eventStream) return doAbort();
+        if (ec == http::error::end_of_stream) {
+            // I still flush responses for requests the client already sent.
+            closing = true;
+            if (slots.empty()) doClose();
+            return;
+        }
+        if (ec) return onReadFailed(ec);
+
+        ++handled;
+        auto slot = std::move(incoming);
+        Request& req = slot->request();
+        bool keepAlive = req.keep_alive() && handled < server.options.maxRequestsPerConnection;
+        if (!keepAlive) closing = true;
+
+        slot->keepAlive = keepAlive;
+        slots.push_back(slot);
+
+        // I let a client force a trace with "X-Trace: 1", about once a
+        // second per address.
+        Tracer& tracer = Tracer::instance();
+        auto traceHeader = req.find("X-Trace");
+        bool forceTrace = traceHeader != req.end() && traceHeader->value() == "1" &&
+                          server.forcedTraceLimiter.allow(clientAddress);
+        slot->traceId = tracer.sampleRequest(forceTrace);
+        std::int64_t queuedAt = 0;
+        if (slot->traceId) {
+            queuedAt = Tracer::nowNanos();
+            if (readStarted) tracer.record(slot->traceId, "read request", readStarted, queuedAt);
+        }
+
+        // I answer fixed responses right here, skipping the worker hop.
+        if (const StaticResponse* fixed = server.findStaticResponse(req)) {
+            slot->raw = fixed->bytes(req.version(), keepAlive);
+            slot->ready = true;
+            doWrite();
+            return doRead();
+        }
+
+        // I turn away rate-limited or shed requests before they take a
+        // place in the worker queue.
+        if (const StaticResponse* rejected = server.admit(req, clientAddress)) {
+            slot->raw = rejected->bytes(req.version(), keepAlive);
+            slot->ready = true;
+            doWrite();
+            return doRead();
+        }
+
+        // I hand the request to the worker pool because handlers may block
+        // on SQLite or the upstream API, then post the result back here.
+        // The slot's arena belongs to the worker until the reply is
+        // posted back, so both hops allocate from it.
+        auto self = shared_from_this();
+        auto postedAt = std::chrono::steady_clock::now();
+        server.noteQueued();
+        net::post(server.workers, inArena(slot->arena, [self, slot, keepAlive, queuedAt, postedAt]() mutable {
+            self->server.noteDequeued(std::chrono::steady_clock::now() - postedAt);
+            TraceContext context(slot->traceId);
+            if (slot->traceId) {
+                Tracer::instance().record(slot->traceId, "wait for worker", queuedAt, Tracer::nowNanos());
+            }
+
+            slot->reply.emplace(self->server.handleRequest(slot->request()));
+            slot->reply->res.keep_alive(keepAlive);
+
+            // I hand my references over so the slot can be recycled as
+            // soon as it is written, even if this thread has not returned.
+            RequestArena& arena = slot->arena;
+            auto executor = self->stream.get_executor();
+            net::post(executor, inArena(arena, [self = std::move(self), slot = std::move(slot)] {
+                slot->ready = true;
+                self->doWrite();
+            }));
+        }));
+
+        doRead();
+    }
+
+    // I stop reading after a failed read and drop the parser, which is
+    // unusable now. A request that did not parse still gets an answer
+    // once the responses queued before it have gone out; a broken or
+    // timed-out socket just closes.
+    void onReadFailed(beast::error_code ec) {
+        closing = true;
+        incoming.reset();
+
+        static const beast::error_category& parseErrors = http::make_error_code(http::error::bad_target).category();
+        if (ec.category() != parseErrors || ec == http::error::partial_message) return;
+
+        auto slot = takeSlot();
+        const StaticResponse& rejected =
+            ec == http::error::body_limit ? server.tooLargeResponse : server.badRequestResponse;
+        slot->raw = rejected.bytes(11, false);
+        slot->keepAlive = false;
+        slot->ready = true;
+        slots.push_back(std::move(slot));
+        doWrite();
+    }
+
+    void doWrite() {
+        if (writing || slots.empty() || !slots.front()->ready) return;
+
+        writing = true;
+        armTimer();
+
+        Slot& slot = *slots.front();
+        if (slot.traceId) slot.writeStarted = Tracer::nowNanos();
+        if (!slot.reply) {
+            net::async_write(stream, net::buffer(slot.raw),
+                             inArena(slot.arena,
+                                     beast::bind_front_handler(&Connection::onWrite, shared_from_this())));
+            return;
+        }
+        bool subscribing = !slot.reply->subscribeCity.empty();
+        if (!slot.reply->stream && !subscribing) {
+            http::async_write(stream, slot.reply->res,
+                              inArena(slot.arena,
+                                      beast::bind_front_handler(&Connection::onWrite, shared_from_this())));
+            return;
+        }
+
+        // I send the head first, then pull body chunks one at a time so
+        // only a single chunk is ever buffered per streaming response.
+        const Response& res = slot.reply->res;
+        slot.head = std::make_unique<http::response<http::empty_body>>(res.result(), res.version());
+        for (const auto& field : res) slot.head->set(field.name_string(), field.value());
+        slot.head->keep_alive(res.keep_alive());
+        slot.head->chunked(true);
+        slot.serializer = std::make_unique<http::response_serializer<http::empty_body>>(*slot.head);
+
+        if (subscribing) {
+            http::async_write_header(stream, *slot.serializer,
+                                     beast::bind_front_handler(&Connection::onEventStreamStarted,
+                                                               shared_from_this()));
+            return;
+        }
+        http::async_write_header(stream, *slot.serializer,
+                                 beast::bind_front_handler(&Connection::onChunkWritten, shared_from_this()));
+    }
+
+    void onChunkWritten(beast::error_code ec, std::size_t) {
+        if (ec) return doAbort();
+
+        auto self = shared_from_this();
+        auto slot = slots.front();
+        if (slot->streamDone) return writeLastChunk();
+
+        // I produce the next chunk on the worker pool since it may hit SQLite.
+        net::post(server.workers, [self, slot] {
+            bool more = false;
+            bool failed = false;
+            slot->chunk.clear();
+            try {
+                more = slot->reply->stream(slot->chunk);
+            }
+            catch (const std::exception&) {
+                failed = true;
+            }
+
+            net::post(self->stream.get_executor(), [self, slot, more, failed] {
+                if (failed) return self->doAbort();
+                slot->streamDone = !more;
+
+                if (slot->chunk.empty()) return self->onChunkWritten({}, 0);
+
+                self->armTimer();
+                net::async_write(self->stream, http::make_chunk(net::buffer(slot->chunk)),
+                                  beast::bind_front_handler(&Connection::onChunkWritten, self));
+            });
+        });
+    }
+
+    void onEventStreamStarted(beast::error_code ec, std::size_t) {
+        if (ec) return doAbort();
+
+        // I only wait for events from here on, so the idle timeout no
+        // longer applies and the read buffer can give its memory back.
+        eventStream = true;
+        clearDeadline();
+        buffer.shrink_to_fit();
+
+        // I hold myself while subscribed, since the hub only holds me
+        // weakly; doAbort lets go on hang-up or when I fall behind.
+        subscription = shared_from_this();
+        server.streams.subscribe(slots.front()->reply->subscribeCity, subscription);
+
+        // I need a read pending to notice the hang-up, also when the
+        // request asked to close and no further request was read.
+        if (!reading) watchHangUp();
+    }
+
+    void watchHangUp() {
+        reading = true;
+        stream.async_read_some(buffer.prepare(64),
+                               beast::bind_front_handler(&Connection::onRead, shared_from_this()));
+    }
+
+    void queueEvent(const std::shared_ptr<const std::string>& event) {
+        if (!stream.is_open()) return;
+        if (events.size() >= server.options.streamQueueLimit) {
+            server.streams.noteDropped();
+            return doAbort();
+        }
+
+        events.push_back(event);
+        writeEvent();
+    }
+
+    // I write straight from the shared event bytes; no copy per client.
+    void writeEvent() {
+        if (eventWriting || events.empty()) return;
+
+        eventWriting = true;
+        setDeadline(kSocketTimeout);
+        net::async_write(stream, http::make_chunk(net::buffer(*events.front())),
+                         beast::bind_front_handler(&Connection::onEventWritten, shared_from_this()));
+    }
+
+    void onEventWritten(beast::error_code ec, std::size_t) {
+        eventWriting = false;
+        events.pop_front();
+        if (ec) return doAbort();
+
+        if (events.empty()) {
+            clearDeadline();
+        } else {
+            writeEvent();
+        }
+    }
+
+    void writeLastChunk() {
+        armTimer();
+        net::async_write(stream, http::make_chunk_last(),
+                          beast::bind_front_handler(&Connection::onWrite, shared_from_this()));
+    }
+
+    // I cannot send an error status once a chunked body has started,
+    // so a failing stream simply drops the connection.
+    void doAbort() {
+        // I release an event stream's hold on me last; every caller still
+        // holds its own reference.
+        std::shared_ptr<Connection> self = std::move(subscription);
+        writing = false;
+        beast::error_code ec;
+        stream.close(ec);
+    }
+
+    void onWrite(beast::error_code ec, std::size_t) {
+        writing = false;
+        const Slot& done = *slots.front();
+        if (done.traceId) {
+            Tracer::instance().record(done.traceId, "write response", done.writeStarted, Tracer::nowNanos());
+        }
+        bool keepAlive = done.keepAlive;
+        recycle(std::move(slots.front()));
+        slots.pop_front();
+        if (ec) return;
+
+        if (!keepAlive || (closing && slots.empty() && !reading)) return doClose();
+
+        doWrite();
+        doRead();
+
+        // I re-arm a read that is already pending so it switches to the
+        // idle timeout once the last queued response has gone out.
+        if (reading && !writing) armTimer();
+    }
+
+    void doClose() {
+        beast::error_code ec;
+        stream.shutdown(tcp::socket::shutdown_send, ec);
+    }
+
+    // I keep a written slot for a later request unless a worker task
+    // still holds it (it is then simply freed when that task is done).
+    void recycle(std::shared_ptr<Slot> slot) {
+        if (slot.use_count() == 1 && spareSlots.size() < server.options.pipelineLimit) {
+            spareSlots.push_back(std::move(slot));
+        }
+    }
+
+    HttpServer& server;
+    ConnectionSocket stream;
+    ConnectionTimer timer;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    std::string clientAddress;
+    beast::flat_buffer buffer;
+    std::shared_ptr<Slot> incoming;
+    std::deque<std::shared_ptr<Slot>> slots;
+    std::vector<std::shared_ptr<Slot>> spareSlots;
+    unsigned handled = 0;
+    std::int64_t readStarted = 0;
+    bool reading = false;
+    bool writing = false;
+    bool closing = false;
+
+    std::deque<std::shared_ptr<const std::string>> events;
+    std::shared_ptr<Connection> subscription;
+    bool eventStream = false;
+    bool eventWriting = false;
+};
 
 // I inject all dependencies so the server does not own application state.
-HttpServer::HttpServer(const std::string& addr, int p, Database& database, AuthService& authService)
-    : address(addr), port(p), db(database), auth(authService) {}
+HttpServer::HttpServer(const std::string& addr, int p, Database& database, AuthService& authService,
+                       WeatherCache& weatherCache, const ServerOptions& opts)
+    : address(addr), port(p), options(opts), db(database), auth(authService), weather(weatherCache),
+      sessions(opts.sessions), tokenLimiter(opts.tokenRateLimit), ipLimiter(opts.ipRateLimit),
+      ioc(static_cast<int>(resolveIoThreads(opts))), acceptor(ioc),
+      workers(resolveWorkerThreads(opts)), fanout(resolveWorkerThreads(opts)),
+      streams(weatherCache, ioc, workers, opts.streamRefresh) {
+    Tracer::instance().configure(options.tracing);
+    buildRoutes();
+}
 
-static std::string getBearerToken(const http::request<http::string_body>& req) {
+// I return a view into the request's Authorization header.
+static std::string_view getBearerToken(const http::request<ArenaStringBody, ArenaFields>& req) {
     auto it = req.find(http::field::authorization);
-    if (it == req.end()) return "";
+    if (it == req.end()) return {};
 
-    std::string value(it->value().data(), it->value().size());
-    const std::string prefix = "Bearer ";
-    if (value.rfind(prefix, 0) != 0) return "";
+    std::string_view value(it->value().data(), it->value().size());
+    constexpr std::string_view prefix = "Bearer ";
+    if (value.substr(0, prefix.size()) != prefix) return {};
 
     return value.substr(prefix.size());
 }
 
-void HttpServer::run() {
-    boost::asio::io_context ioc{1};
-    tcp::acceptor acceptor{
-        ioc,
-        { boost::asio::ip::make_address(address),
-          static_cast<unsigned short>(port) }
-    };
+// I split "/path?query" without copying; query excludes the '?'.
+static void splitTarget(std::string_view target, std::string_view& path, std::string_view& query) {
+    auto q = target.find('?');
+    path = target.substr(0, q);
+    query = q == std::string_view::npos ? std::string_view{} : target.substr(q + 1);
+}
 
-    std::cout << "Server running at http://" << address << ":" << port << "\n";
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-    for (;;) {
-        tcp::socket socket{ioc};
-        acceptor.accept(socket);
+// I find one query parameter and percent-decode it into out.
+static bool queryParam(std::string_view query, std::string_view name, std::string& out) {
+    while (!query.empty()) {
+        auto amp = query.find('&');
+        std::string_view pair = query.substr(0, amp);
+        query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
 
-        boost::beast::flat_buffer buffer;
-        http::request<http::string_body> req;
-        http::read(socket, buffer, req);
+        auto eq = pair.find('=');
+        if (pair.substr(0, eq) != name) continue;
 
-        http::response<http::string_body> res{http::status::ok, req.version()};
-        res.set(http::field::content_type, "application/json");
-        res.set(http::field::access_control_allow_origin, "*");
-        res.set(http::field::access_control_allow_headers, "Authorization, Content-Type");
-        res.set(http::field::access_control_allow_methods, "GET, POST, OPTIONS");
-
-        // HARD STOP for CORS preflight
-        if (req.method() == http::verb::options) {
-            res.result(http::status::ok);
-            res.body() = "";
-            res.prepare_payload();
-            http::write(socket, res);
-            socket.shutdown(tcp::socket::shutdown_send);
-            continue;
-        }
-
-        try {
-            if (req.method() == http::verb::get && req.target() == "/health") {
-                res.body() = R"({"status":"ok"})";
+        std::string_view raw = eq == std::string_view::npos ? std::string_view{} : pair.substr(eq + 1);
+        out.clear();
+        for (std::size_t i = 0; i < raw.size(); ++i) {
+            if (raw[i] == '+') {
+                out += ' ';
+            } else if (raw[i] == '%' && i + 2 < raw.size() &&
+                       hexValue(raw[i + 1]) >= 0 && hexValue(raw[i + 2]) >= 0) {
+                out += static_cast<char>(hexValue(raw[i + 1]) * 16 + hexValue(raw[i + 2]));
+                i += 2;
+            } else {
+                out += raw[i];
             }
+        }
+        return true;
+    }
+    return false;
+}
+
+// I compare validators weakly (W/ ignored), as If-None-Match requires.
+static bool ifNoneMatch(const http::request<ArenaStringBody, ArenaFields>& req, std::string_view etag) {
+    auto it = req.find(http::field::if_none_match);
+    if (it == req.end()) return false;
+
+    auto opaque = [](std::string_view tag) {
+        while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) tag.remove_prefix(1);
+        while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) tag.remove_suffix(1);
+        if (tag.substr(0, 2) == "W/") tag.remove_prefix(2);
+        return tag;
+    };
+
+    std::string_view wanted = opaque(etag);
+    std::string_view list(it->value().data(), it->value().size());
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        std::string_view tag = opaque(list.substr(0, comma));
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+        if (tag == "*" || tag == wanted) return true;
+    }
+    return false;
+}
+
+// I attach a validator and answer 304 with no body when the client
+// already holds it. Returns true when the handler is done.
+static bool notModified(const http::request<ArenaStringBody, ArenaFields>& req,
+                        http::response<ArenaStringBody, ArenaFields>& res, std::string_view etag) {
+    res.set(http::field::etag, beast::string_view(etag.data(), etag.size()));
+    res.set(http::field::cache_control, "private, no-cache");
+    if (!ifNoneMatch(req, etag)) return false;
+
+    res.result(http::status::not_modified);
+    res.body().clear();
+    return true;
+}
 
-            else if (req.method() == http::verb::post && req.target() == "/auth/register") {
-                auto body = nlohmann::json::parse(req.body());
-                bool ok = auth.registerUser(
-                    body["username"].get<std::string>(),
-                    body["password"].get<std::string>()
-                );
-                res.body() = nlohmann::json{{"success", ok}}.dump();
+// I hash with FNV-1a because it is stable across runs and instances,
+// unlike std::hash, so ETags survive a restart.
+static std::uint64_t fnv1a(std::string_view text) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void HttpServer::doAccept() {
+    // I give every accepted socket its own strand so the connection
+    // can be driven from any I/O thread without extra locking.
+    using Socket = ConnectionSocket;
+    acceptor.async_accept(net::make_strand(ioc.get_executor()), [this](beast::error_code ec, Socket socket) {
+        if (!acceptor.is_open()) return;
+        if (!ec) {
+            std::make_shared<Connection>(*this, std::move(socket))->start();
+        }
+        doAccept();
+    });
+}
+
+void HttpServer::stop() {
+    net::post(ioc, [this] {
+        beast::error_code ec;
+        acceptor.close(ec);
+        streams.stop();
+        ioc.stop();
+    });
+}
+
+void HttpServer::run() {
+    tcp::endpoint endpoint{ net::ip::make_address(address), static_cast<unsigned short>(port) };
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(net::socket_base::reuse_address(true));
+    acceptor.bind(endpoint);
+    acceptor.listen(net::socket_base::max_listen_connections);
+
+    // I stop cleanly on Ctrl+C so destructors (and the database) run.
+    net::signal_set signals(ioc, SIGINT, SIGTERM);
+    signals.async_wait([this](const beast::error_code&, int) { stop(); });
+
+#ifdef SIGUSR1
+    net::signal_set traceSignals(ioc, SIGUSR1);
+    armTraceSignal(traceSignals);
+#endif
+
+    doAccept();
+    streams.start();
+
+    unsigned ioThreads = resolveIoThreads(options);
+    std::cout << "Server running at http://" << address << ":" << port
+              << " (" << ioThreads << " I/O threads, "
+              << resolveWorkerThreads(options) << " workers)\n";
+
+    std::vector<std::thread> threads;
+    threads.reserve(ioThreads - 1);
+    for (unsigned i = 1; i < ioThreads; ++i) {
+        threads.emplace_back([this] { ioc.run(); });
+    }
+    ioc.run();
+
+    for (auto& t : threads) t.join();
+    workers.join();
+    fanout.join();
+}
+
+void HttpServer::armTraceSignal(net::signal_set& signals) {
+    signals.async_wait([this, &signals](const beast::error_code& ec, int) {
+        if (ec) return;
+
+        // I write the file off the I/O threads; a dump walks every buffer.
+        net::post(workers, [] {
+            auto seconds = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            std::string path = "weather-trace-" + std::to_string(seconds) + ".json";
+            if (Tracer::instance().writeChromeTrace(path)) {
+                std::cout << "Wrote trace to " << path << "\n";
+            } else {
+                std::cerr << "Could not write trace to " << path << "\n";
             }
+        });
+        armTraceSignal(signals);
+    });
+}
+
+// I set the headers every dynamic response shares in one place.
+static void setCommonHeaders(http::response<ArenaStringBody, ArenaFields>& res) {
+    res.set(http::field::content_type, "application/json");
+    res.set(http::field::access_control_allow_origin, "*");
+    res.set(http::field::access_control_allow_headers, "Authorization, Content-Type, If-None-Match");
+    res.set(http::field::access_control_allow_methods, "GET, POST, OPTIONS");
+    res.set(http::field::access_control_expose_headers, "X-Next-Cursor, ETag");
+}
+
+void HttpServer::buildRoutes() {
+    // I serialize the responses that never change exactly once.
+    Response fixed{http::status::ok, 11};
+    setCommonHeaders(fixed);
+    preflightResponse = StaticResponse(fixed);
+
+    fixed.body() = R"({"status":"ok"})";
+    healthResponse = StaticResponse(fixed);
+
+    // I answer a request that cannot be parsed with these, then close.
+    fixed.result(http::status::bad_request);
+    fixed.body() = R"({"error":"malformed request"})";
+    badRequestResponse = StaticResponse(fixed);
+    fixed.result(http::status::payload_too_large);
+    fixed.body() = R"({"error":"request body too large"})";
+    tooLargeResponse = StaticResponse(fixed);
+
+    // I build the rejections here too; Retry-After is fixed per limiter.
+    fixed.result(http::status::too_many_requests);
+    fixed.body() = R"({"error":"rate limit exceeded"})";
+    fixed.set(http::field::retry_after, std::to_string(tokenLimiter.retryAfter().count()));
+    tokenLimitedResponse = StaticResponse(fixed);
+    fixed.set(http::field::retry_after, std::to_string(ipLimiter.retryAfter().count()));
+    ipLimitedResponse = StaticResponse(fixed);
+
+    fixed.result(http::status::service_unavailable);
+    fixed.body() = R"({"error":"server overloaded"})";
+    fixed.set(http::field::retry_after, "1");
+    overloadedResponse = StaticResponse(fixed);
+
+    addRoute(http::verb::get,  "/health",          RouteTarget{ nullptr, &healthResponse });
+    addRoute(http::verb::post, "/auth/register",   RouteTarget{ &HttpServer::handleRegister });
+    addRoute(http::verb::post, "/auth/login",      RouteTarget{ &HttpServer::handleLogin });
+    addRoute(http::verb::post, "/auth/logout",     RouteTarget{ &HttpServer::handleLogout });
+    addRoute(http::verb::post, "/weather/current", RouteTarget{ &HttpServer::handleWeather });
+    addRoute(http::verb::get,  "/weather/stream",  RouteTarget{ &HttpServer::handleWeatherStream });
+    addRoute(http::verb::post, "/weather/batch",   RouteTarget{ &HttpServer::handleWeatherBatch });
+    addRoute(http::verb::get,  "/history",         RouteTarget{ &HttpServer::handleHistory });
+    addRoute(http::verb::get,  "/stats/cache",     RouteTarget{ &HttpServer::handleCacheStats });
+    addRoute(http::verb::get,  "/stats/cities",    RouteTarget{ &HttpServer::handleCityStats });
+    addRoute(http::verb::get,  "/metrics",         RouteTarget{ &HttpServer::handleMetrics });
+    addRoute(http::verb::get,  "/debug/trace",     RouteTarget{ &HttpServer::handleTraceDump });
 
-            else if (req.method() == http::verb::post && req.target() == "/auth/login") {
-                auto body = nlohmann::json::parse(req.body());
-                int userId = auth.loginUser(
-                    body["username"].get<std::string>(),
-                    body["password"].get<std::string>()
-                );
+    routeStats.emplace_back(R"(method="OPTIONS",route="*")", "OPTIONS *");
+    preflightLatency = &routeStats.back().latency;
+    routeStats.emplace_back(R"(method="",route="unmatched")", "unmatched");
+    unmatchedLatency = &routeStats.back().latency;
+}
+
+void HttpServer::addRoute(http::verb method, std::string_view pattern, RouteTarget target) {
+    auto verb = http::to_string(method);
+    std::string methodName(verb.data(), verb.size());
+    routeStats.emplace_back("method=\"" + methodName + "\",route=\"" +
+                            prometheus::escapeLabel(pattern) + "\"",
+                            methodName + " " + std::string(pattern));
+    target.latency = &routeStats.back().latency;
+    target.traceName = routeStats.back().traceName.c_str();
+    router.add(method, pattern, target);
+}
+
+const StaticResponse* HttpServer::findStaticResponse(const Request& req) const {
+    // HARD STOP for CORS preflight
+    if (req.method() == http::verb::options) {
+        ScopedLatency timer(preflightLatency);
+        return &preflightResponse;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string_view path, query;
+    splitTarget({ req.target().data(), req.target().size() }, path, query);
+
+    RouteTarget target;
+    RouteParams params;
+    if (router.find(req.method(), path, target, params) == Router<RouteTarget>::Match::found &&
+        target.fixed) {
+        target.latency->record(std::chrono::steady_clock::now() - start);
+        return target.fixed;
+    }
+    return nullptr;
+}
+
+const StaticResponse* HttpServer::admit(const Request& req, const std::string& clientAddress) {
+    // I check the address first: it cannot be rotated as freely as a
+    // token, so it also bounds clients that invent tokens.
+    if (!clientAddress.empty() && !ipLimiter.allow(clientAddress)) return &ipLimitedResponse;
+
+    if (tokenLimiter.enabled()) {
+        std::string_view token = getBearerToken(req);
+        std::string fromQuery;
+        if (token.empty()) {
+            std::string_view path, query;
+            splitTarget({ req.target().data(), req.target().size() }, path, query);
+            if (queryParam(query, "access_token", fromQuery)) token = fromQuery;
+        }
+        if (!token.empty() && !tokenLimiter.allow(token)) return &tokenLimitedResponse;
+    }
+
+    // I shed only while a queue exists: the average lags, and an idle
+    // pool should never turn requests away.
+    if (options.queueBudget.count() > 0 &&
+        queuedRequests.load(std::memory_order_relaxed) > 0 &&
+        queueDelayNanos.load(std::memory_order_relaxed) >
+            std::chrono::duration_cast<std::chrono::nanoseconds>(options.queueBudget).count()) {
+        shedRequests.fetch_add(1, std::memory_order_relaxed);
+        return &overloadedResponse;
+    }
+    return nullptr;
+}
+
+void HttpServer::noteDequeued(std::chrono::steady_clock::duration waited) {
+    queuedRequests.fetch_sub(1, std::memory_order_relaxed);
+
+    // I fold the sample in with a CAS loop so racing workers keep theirs.
+    std::int64_t sample = std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count();
+    std::int64_t average = queueDelayNanos.load(std::memory_order_relaxed);
+    while (!queueDelayNanos.compare_exchange_weak(average, average + (sample - average) / 8,
+                                                  std::memory_order_relaxed)) {
+    }
+}
+
+HttpServer::Reply HttpServer::handleRequest(const Request& req) {
+    ArenaAllocator alloc = req.get_allocator();
+    Reply reply{ Response{http::status::ok, req.version(), alloc, alloc}, nullptr, {} };
+    Response& res = reply.res;
+    setCommonHeaders(res);
+
+    RequestContext ctx{ req, {}, {}, {} };
+    splitTarget({ req.target().data(), req.target().size() }, ctx.path, ctx.query);
 
-                if (userId < 0) {
-                    res.result(http::status::unauthorized);
-                    res.body() = R"({"error":"invalid credentials"})";
+    // I time until the reply is built; streamed bodies are produced later.
+    RouteTarget target;
+    target.latency = unmatchedLatency;
+    target.traceName = "unmatched";
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t traceId = Tracer::currentTrace();
+    std::int64_t traceStart = traceId ? Tracer::nowNanos() : 0;
+
+    try {
+        switch (router.find(req.method(), ctx.path, target, ctx.params)) {
+            case Router<RouteTarget>::Match::found:
+                if (target.handler) {
+                    (this->*target.handler)(ctx, reply);
                 } else {
-                    res.body() = nlohmann::json{
-                        {"token", sessions.createSession(userId, body["username"])},
-                        {"username", body["username"]}
-                    }.dump();
+                    // I only get here if a caller skipped findStaticResponse.
+                    res.body() = target.fixed->body();
                 }
-            }
+                break;
+            case Router<RouteTarget>::Match::methodNotAllowed:
+                res.result(http::status::method_not_allowed);
+                res.body() = R"({"error":"method not allowed"})";
+                break;
+            case Router<RouteTarget>::Match::notFound:
+                res.result(http::status::not_found);
+                res.body() = R"({"error":"not found"})";
+                break;
+        }
+    }
+    catch (const std::exception& e) {
+        res.result(http::status::bad_request);
+        res.body() = nlohmann::json{{"error", e.what()}}.dump();
+        reply.stream = nullptr;
+        reply.subscribeCity.clear();
+    }
 
-            else if (req.method() == http::verb::post && req.target() == "/weather/current") {
-                Session session;
-                if (!sessions.validateToken(getBearerToken(req), session)) {
-                    res.result(http::status::unauthorized);
-                    res.body() = R"({"error":"unauthorized"})";
-                } else {
-                    auto body = nlohmann::json::parse(req.body());
-                    WeatherClient weather;
-                    std::string summary = weather.getWeather(body["city"]);
-                    db.logQuery(session.userId, body["city"], summary);
-                    res.body() = nlohmann::json{{"summary", summary}}.dump();
+    // I can only stream a body in chunks, which HTTP/1.0 does not have.
+    if ((reply.stream || !reply.subscribeCity.empty()) && req.version() < 11) {
+        res.result(http::status::http_version_not_supported);
+        res.set(http::field::content_type, "application/json");
+        res.erase(http::field::cache_control);
+        res.body() = R"({"error":"streaming requires HTTP/1.1"})";
+        reply.stream = nullptr;
+        reply.subscribeCity.clear();
+    }
+
+    compressReply(req, reply);
+
+    // I leave framing to the connection when the body is streamed, and
+    // a 304 carries no body to frame.
+    if (!reply.stream && reply.subscribeCity.empty() && res.result() != http::status::not_modified) {
+        res.prepare_payload();
+    }
+    target.latency->record(std::chrono::steady_clock::now() - start);
+    if (traceId) Tracer::instance().record(traceId, target.traceName, traceStart, Tracer::nowNanos());
+    return reply;
+}
+
+void HttpServer::compressReply(const Request& req, Reply& reply) {
+    // I leave event streams alone: every subscriber shares one copy of
+    // each event, which per-client compression would undo.
+    if (options.compressionLevel <= 0 || !reply.subscribeCity.empty()) return;
+
+    Response& res = reply.res;
+    if (!reply.stream && res.body().size() < options.compressMinBytes) return;
+    if (res.find(http::field::content_encoding) != res.end()) return;
+
+    // I tell caches the body depends on Accept-Encoding even when I end up
+    // sending it as is.
+    res.set(http::field::vary, "Accept-Encoding");
+    auto accept = req.find(http::field::accept_encoding);
+    if (accept == req.end()) return;
+    ContentCoding coding = negotiateContentCoding({ accept->value().data(), accept->value().size() });
+    if (coding == ContentCoding::identity) return;
+
+    if (reply.stream) {
+        auto compressor = std::make_shared<StreamCompressor>(coding, options.compressionLevel, &compression);
+        auto raw = std::make_shared<std::string>();
+        reply.stream = [source = std::move(reply.stream), compressor, raw](std::string& chunk) {
+            raw->clear();
+            bool more = source(*raw);
+            compressor->write(*raw, !more, chunk);
+            return more;
+        };
+    } else {
+        TraceSpan span("compress response");
+        // I compress into a per-thread buffer that keeps its capacity, then
+        // copy the result back into the arena.
+        thread_local std::string compressed;
+        if (!compressBody(res.body(), coding, options.compressionLevel, compressed, &compression)) return;
+        res.body().assign(compressed);
+    }
+    res.set(http::field::content_encoding, contentCodingName(coding));
+    compression.responses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HttpServer::handleRegister(const RequestContext& ctx, Reply& reply) {
+    auto body = nlohmann::json::parse(ctx.req.body());
+    bool ok = auth.registerUser(
+        body["username"].get<std::string>(),
+        body["password"].get<std::string>()
+    );
+    reply.res.body() = nlohmann::json{{"success", ok}}.dump();
+}
+
+void HttpServer::handleLogin(const RequestContext& ctx, Reply& reply) {
+    auto body = nlohmann::json::parse(ctx.req.body());
+    int userId = auth.loginUser(
+        body["username"].get<std::string>(),
+        body["password"].get<std::string>()
+    );
+
+    if (userId < 0) {
+        reply.res.result(http::status::unauthorized);
+        reply.res.body() = R"({"error":"invalid credentials"})";
+    } else {
+        reply.res.body() = nlohmann::json{
+            {"token", sessions.createSession(userId, body["username"])},
+            {"username", body["username"]}
+        }.dump();
+    }
+}
+
+void HttpServer::handleLogout(const RequestContext& ctx, Reply& reply) {
+    bool ok = sessions.removeSession(getBearerToken(ctx.req));
+    reply.res.body() = nlohmann::json{{"success", ok}}.dump();
+}
+
+// I pull the top-level "city" out of a lookup body as it streams by, so
+// the hottest route builds no JSON tree per request.
+class CitySax : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit CitySax(std::string& target) : out(target) {}
+
+    bool found = false;
+
+    bool null() override { wanted = false; return true; }
+    bool boolean(bool) override { wanted = false; return true; }
+    bool number_integer(number_integer_t) override { wanted = false; return true; }
+    bool number_unsigned(number_unsigned_t) override { wanted = false; return true; }
+    bool number_float(number_float_t, const string_t&) override { wanted = false; return true; }
+
+    bool string(string_t& value) override {
+        if (wanted) {
+            out = std::move(value);
+            found = true;
+        }
+        wanted = false;
+        return true;
+    }
+
+    bool binary(binary_t&) override { return true; }
+
+    bool start_object(std::size_t) override { ++depth; wanted = false; return true; }
+    bool end_object() override { --depth; return true; }
+    bool start_array(std::size_t) override { ++depth; wanted = false; return true; }
+    bool end_array() override { --depth; return true; }
+
+    bool key(string_t& name) override {
+        wanted = depth == 1 && name == "city";
+        return true;
+    }
+
+    // I keep nlohmann's message; the router turns it into a 400.
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        throw std::invalid_argument(ex.what());
+    }
+
+private:
+    std::string& out;
+    int depth = 0;
+    bool wanted = false;
+};
+
+void HttpServer::handleWeather(const RequestContext& ctx, Reply& reply) {
+    Session session;
+    bool valid;
+    {
+        TraceSpan span("validate token");
+        valid = sessions.validateToken(getBearerToken(ctx.req), session);
+    }
+    if (!valid) {
+        reply.res.result(http::status::unauthorized);
+        reply.res.body() = R"({"error":"unauthorized"})";
+        return;
+    }
+
+    std::string city;
+    CitySax cityReader(city);
+    nlohmann::json::sax_parse(ctx.req.body().begin(), ctx.req.body().end(), &cityReader);
+    if (!cityReader.found) throw std::invalid_argument("city must be a string");
+
+    std::shared_ptr<const WeatherObservation> observation;
+    std::string error;
+    bool ok;
+    bool overloaded = false;
+    {
+        TraceSpan span("weather lookup");
+        ok = weather.getObservation(city, observation, error, &overloaded);
+    }
+
+    // I answer a shed upstream fetch with 503 and log nothing: the user
+    // did not get a reading and should simply retry.
+    if (overloaded) {
+        reply.res.result(http::status::service_unavailable);
+        reply.res.set(http::field::retry_after, "1");
+        reply.res.body() = R"({"error":"weather service busy"})";
+        return;
+    }
+
+    // I only turn the observation into text here, at the edge; failures
+    // keep the old shape (the error text as the summary).
+    std::string summary = ok ? observation->summary() : error;
+    {
+        TraceSpan span("queue query log");
+        db.logQuery(session.userId, city, summary, ok ? observation.get() : nullptr);
+    }
+
+    // I tag a reading by when upstream observed it and the city text it
+    // carries, the only inputs to the body, so a repeat is answered
+    // without serializing anything.
+    if (ok) {
+        char etag[48];
+        std::snprintf(etag, sizeof(etag), "W/\"w%lld-%016llx\"",
+                      static_cast<long long>(observation->observedAt),
+                      static_cast<unsigned long long>(fnv1a(observation->city)));
+        if (notModified(ctx.req, reply.res, etag)) return;
+    }
+
+    TraceSpan span("serialize response");
+    ArenaString& out = reply.res.body();
+    out = "{";
+    json_writer::appendKey(out, "summary");
+    json_writer::appendString(out, summary);
+    if (ok) {
+        out.push_back(',');
+        json_writer::appendKey(out, "observation");
+        observation->appendJson(out);
+    }
+    out.push_back('}');
+}
+
+void HttpServer::handleWeatherStream(const RequestContext& ctx, Reply& reply) {
+    // I also take the token from ?access_token= since browsers cannot
+    // set headers on an EventSource.
+    std::string_view token = getBearerToken(ctx.req);
+    std::string fromQuery;
+    if (token.empty() && queryParam(ctx.query, "access_token", fromQuery)) token = fromQuery;
+
+    Session session;
+    if (!sessions.validateToken(token, session)) {
+        reply.res.result(http::status::unauthorized);
+        reply.res.body() = R"({"error":"unauthorized"})";
+        return;
+    }
+
+    std::string city;
+    if (!queryParam(ctx.query, "city", city) || city.empty()) {
+        throw std::invalid_argument("city is required");
+    }
+
+    reply.res.set(http::field::content_type, "text/event-stream");
+    reply.res.set(http::field::cache_control, "no-cache");
+    reply.subscribeCity = std::move(city);
+}
+
+namespace {
+
+// I am shared between a batch handler and its fan-out tasks. Tasks may
+// outlive the handler when the deadline passes, so they only publish a
+// result while the batch is still open.
+struct WeatherBatch {
+    struct Result {
+        bool finished = false;
+        bool ok = false;
+        std::shared_ptr<const WeatherObservation> observation;
+        std::string error;
+    };
+
+    std::vector<std::string> cities;
+    std::atomic<std::size_t> next{0};
+    std::chrono::steady_clock::time_point deadline;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Result> results;
+    std::size_t finished = 0;
+    bool closed = false;
+};
+
+} // namespace
+
+void HttpServer::handleWeatherBatch(const RequestContext& ctx, Reply& reply) {
+    Session session;
+    if (!sessions.validateToken(getBearerToken(ctx.req), session)) {
+        reply.res.result(http::status::unauthorized);
+        reply.res.body() = R"({"error":"unauthorized"})";
+        return;
+    }
+
+    auto body = nlohmann::json::parse(ctx.req.body());
+    const auto& list = body.at("cities");
+    if (!list.is_array() || list.empty()) {
+        throw std::invalid_argument("cities must be a non-empty array");
+    }
+    if (list.size() > options.batchMaxCities) {
+        throw std::invalid_argument("at most " + std::to_string(options.batchMaxCities) +
+                                    " cities per batch");
+    }
+
+    auto batch = std::make_shared<WeatherBatch>();
+    for (const auto& city : list) batch->cities.push_back(city.get<std::string>());
+    batch->results.resize(batch->cities.size());
+    batch->deadline = std::chrono::steady_clock::now() + options.batchDeadline;
+
+    // I start at most batchParallelism tasks; each keeps claiming the
+    // next unclaimed city until the list or the time runs out.
+    std::size_t tasks = std::min<std::size_t>(std::max(1u, options.batchParallelism),
+                                              batch->cities.size());
+    for (std::size_t t = 0; t < tasks; ++t) {
+        net::post(fanout, [this, batch, traceId = Tracer::currentTrace()] {
+            TraceContext context(traceId);
+            for (;;) {
+                std::size_t i = batch->next.fetch_add(1, std::memory_order_relaxed);
+                if (i >= batch->cities.size() ||
+                    std::chrono::steady_clock::now() >= batch->deadline) {
+                    return;
                 }
-            }
 
-            else if (req.method() == http::verb::get && req.target() == "/history") {
-                Session session;
-                if (!sessions.validateToken(getBearerToken(req), session)) {
-                    res.result(http::status::unauthorized);
-                    res.body() = R"({"error":"unauthorized"})";
-                } else {
-                    auto rows = db.getHistory(session.userId);
-                    std::vector<nlohmann::json> out;
-                    for (const auto& r : rows) {
-                        out.push_back({
-                            {"timestamp", r.timestamp},
-                            {"city", r.city},
-                            {"summary", r.summary}
-                        });
-                    }
-                    res.body() = nlohmann::json(out).dump();
+                WeatherBatch::Result result;
+                TraceSpan span("batch city lookup");
+                try {
+                    result.ok = weather.getObservation(batch->cities[i], result.observation, result.error);
                 }
-            }
+                catch (const std::exception& e) {
+                    result.error = std::string("Error: ") + e.what();
+                }
+                result.finished = true;
 
-            else {
-                res.result(http::status::not_found);
-                res.body() = R"({"error":"not found"})";
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                if (batch->closed) return;
+                batch->results[i] = std::move(result);
+                if (++batch->finished == batch->cities.size()) batch->changed.notify_one();
             }
+        });
+    }
+
+    std::vector<WeatherBatch::Result> results;
+    {
+        TraceSpan span("wait for batch");
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->changed.wait_until(lock, batch->deadline, [&batch] {
+            return batch->finished == batch->cities.size();
+        });
+        batch->closed = true;
+        results.swap(batch->results);
+    }
+
+    // I log every city, timed out or not, in a single transaction.
+    std::vector<QueryLogEntry> logs;
+    logs.reserve(results.size());
+
+    ArenaString& out = reply.res.body();
+    out = "{";
+    json_writer::appendKey(out, "results");
+    out.push_back('[');
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        if (i > 0) out.push_back(',');
+
+        std::string summary;
+        if (!result.finished) summary = "Error: timed out";
+        else summary = result.ok ? result.observation->summary() : result.error;
+
+        out.push_back('{');
+        json_writer::appendKey(out, "city");
+        json_writer::appendString(out, batch->cities[i]);
+        out.push_back(',');
+        json_writer::appendKey(out, "ok");
+        out += result.ok ? "true" : "false";
+        out.push_back(',');
+        json_writer::appendKey(out, result.ok ? "summary" : "error");
+        json_writer::appendString(out, summary);
+        if (result.ok) {
+            out.push_back(',');
+            json_writer::appendKey(out, "observation");
+            result.observation->appendJson(out);
         }
-        catch (const std::exception& e) {
-            res.result(http::status::bad_request);
-            res.body() = nlohmann::json{{"error", e.what()}}.dump();
+        out.push_back('}');
+
+        QueryLogEntry entry{ session.userId, batch->cities[i], std::move(summary) };
+        if (result.ok) {
+            entry.hasReading = true;
+            entry.tempC = result.observation->tempC;
+            entry.windKph = result.observation->windKph;
         }
+        logs.push_back(std::move(entry));
+    }
+    out += "]}";
 
-        res.prepare_payload();
-        http::write(socket, res);
-        socket.shutdown(tcp::socket::shutdown_send);
+    db.logQueries(std::move(logs));
+}
+
+void HttpServer::handleMetrics(const RequestContext&, Reply& reply) {
+    // I render into a plain string (the Prometheus writers take one) and
+    // copy it into the arena once; a scrape is not a hot path.
+    std::string out;
+    out.reserve(64 * 1024);
+    reply.res.set(http::field::content_type, "text/plain; version=0.0.4");
+
+    prometheus::appendHeader(out, "weather_http_request_duration_seconds", "histogram",
+                             "Time to build a response, by route (streamed bodies excluded).");
+    for (const auto& route : routeStats) {
+        route.latency.appendPrometheus(out, "weather_http_request_duration_seconds", route.labels);
+    }
+
+    prometheus::appendSample(out, "weather_http_connections_open", "gauge",
+                             "Client connections currently open.",
+                             static_cast<double>(openConnections.load(std::memory_order_relaxed)));
+    prometheus::appendSample(out, "weather_http_connections_accepted_total", "counter",
+                             "Client connections accepted since start.",
+                             static_cast<double>(acceptedConnections.load(std::memory_order_relaxed)));
+    prometheus::appendHeader(out, "weather_http_rejected_total", "counter",
+                             "Requests turned away before reaching a worker, by reason.");
+    const std::pair<const char*, std::uint64_t> rejections[] = {
+        { "ip", ipLimiter.rejected() },
+        { "token", tokenLimiter.rejected() },
+        { "overload", shedRequests.load(std::memory_order_relaxed) },
+    };
+    for (const auto& rejection : rejections) {
+        out += "weather_http_rejected_total{reason=\"";
+        out += rejection.first;
+        out += "\"} ";
+        out += std::to_string(rejection.second);
+        out += '\n';
+    }
+    prometheus::appendSample(out, "weather_http_worker_queue_depth", "gauge",
+                             "Requests waiting for a worker thread.",
+                             static_cast<double>(queuedRequests.load(std::memory_order_relaxed)));
+    prometheus::appendSample(out, "weather_http_worker_queue_delay_seconds", "gauge",
+                             "Moving average of the time requests wait for a worker.",
+                             static_cast<double>(queueDelayNanos.load(std::memory_order_relaxed)) / 1e9);
+    prometheus::appendSample(out, "weather_rate_limit_tracked_keys", "gauge",
+                             "Tokens and addresses with a partly spent rate-limit bucket.",
+                             static_cast<double>(tokenLimiter.trackedKeys() + ipLimiter.trackedKeys()));
+    prometheus::appendSample(out, "weather_sessions_active", "gauge",
+                             "In-memory sessions, including expired ones not yet swept.",
+                             static_cast<double>(sessions.activeSessions()));
+
+    const UpstreamMetrics& upstream = weather.upstreamClient().metrics();
+    prometheus::appendHeader(out, "weather_upstream_request_duration_seconds", "histogram",
+                             "Time spent in weather API requests, failures included.");
+    upstream.latency.appendPrometheus(out, "weather_upstream_request_duration_seconds", "");
+    prometheus::appendSample(out, "weather_upstream_failures_total", "counter",
+                             "Weather API lookups that did not produce an observation.",
+                             static_cast<double>(upstream.failures.load(std::memory_order_relaxed)));
+    prometheus::appendSample(out, "weather_upstream_timeouts_total", "counter",
+                             "Weather API calls that missed a resolve, connect, handshake or response deadline.",
+                             static_cast<double>(upstream.timeouts.load(std::memory_order_relaxed)));
+    prometheus::appendSample(out, "weather_upstream_hedges_total", "counter",
+                             "Second weather API calls sent because the first ran late.",
+                             static_cast<double>(upstream.hedges.load(std::memory_order_relaxed)));
+    prometheus::appendSample(out, "weather_upstream_hedge_wins_total", "counter",
+                             "Hedged lookups answered by the second call.",
+                             static_cast<double>(upstream.hedgeWins.load(std::memory_order_relaxed)));
+
+    const CircuitBreaker& breaker = weather.upstreamClient().breaker();
+    prometheus::appendSample(out, "weather_upstream_breaker_open", "gauge",
+                             "1 while the upstream circuit breaker is open, 0.5 half-open, 0 closed.",
+                             breaker.state() == CircuitBreaker::State::open       ? 1.0
+                             : breaker.state() == CircuitBreaker::State::halfOpen ? 0.5
+                                                                                  : 0.0);
+    prometheus::appendSample(out, "weather_upstream_breaker_opens_total", "counter",
+                             "Times the upstream circuit breaker opened.",
+                             static_cast<double>(breaker.opened()));
+    prometheus::appendSample(out, "weather_upstream_breaker_rejections_total", "counter",
+                             "Lookups failed fast while the circuit breaker was open.",
+                             static_cast<double>(breaker.rejected()));
+
+    WeatherStreamStats stream = streams.stats();
+    prometheus::appendSample(out, "weather_stream_subscribers", "gauge",
+                             "Open /weather/stream connections.",
+                             static_cast<double>(stream.subscribers));
+    prometheus::appendSample(out, "weather_stream_cities", "gauge",
+                             "Cities refreshed for stream subscribers.",
+                             static_cast<double>(stream.cities));
+    prometheus::appendSample(out, "weather_stream_events_total", "counter",
+                             "Weather and error events handed to subscribers.",
+                             static_cast<double>(stream.events));
+    prometheus::appendSample(out, "weather_stream_dropped_total", "counter",
+                             "Subscribers disconnected for falling behind.",
+                             static_cast<double>(stream.dropped));
+
+    WeatherCacheStats cache = weather.stats();
+    prometheus::appendSample(out, "weather_cache_hits_total", "counter", "Weather cache hits.",
+                             static_cast<double>(cache.hits));
+    prometheus::appendSample(out, "weather_cache_misses_total", "counter", "Weather cache misses.",
+                             static_cast<double>(cache.misses));
+    prometheus::appendSample(out, "weather_cache_coalesced_total", "counter",
+                             "Lookups that joined a fetch already in flight.",
+                             static_cast<double>(cache.coalesced));
+    prometheus::appendSample(out, "weather_cache_evictions_total", "counter", "Weather cache evictions.",
+                             static_cast<double>(cache.evictions));
+    prometheus::appendSample(out, "weather_cache_entries", "gauge", "Cities currently cached.",
+                             static_cast<double>(cache.size));
+    prometheus::appendSample(out, "weather_upstream_fetches_in_flight", "gauge",
+                             "Weather API fetches currently running.",
+                             static_cast<double>(cache.fetching));
+    prometheus::appendSample(out, "weather_upstream_shed_total", "counter",
+                             "Cache misses failed because the upstream fetch limit was reached.",
+                             static_cast<double>(cache.shed));
+    prometheus::appendSample(out, "weather_cache_stale_served_total", "counter",
+                             "Expired readings served because a refresh failed or was shed.",
+                             static_cast<double>(cache.staleServed));
+
+    prometheus::appendHeader(out, "weather_http_compression_duration_seconds", "histogram",
+                             "Time spent in zlib per compressed body or chunk.");
+    compression.latency.appendPrometheus(out, "weather_http_compression_duration_seconds", "");
+    std::uint64_t compressedIn = compression.bytesIn.load(std::memory_order_relaxed);
+    std::uint64_t compressedOut = compression.bytesOut.load(std::memory_order_relaxed);
+    prometheus::appendSample(out, "weather_http_compressed_responses_total", "counter",
+                             "Responses sent with a gzip or deflate Content-Encoding.",
+                             static_cast<double>(compression.responses.load(std::memory_order_relaxed)));
+    prometheus::appendSample(out, "weather_http_compression_input_bytes_total", "counter",
+                             "Body bytes before compression.", static_cast<double>(compressedIn));
+    prometheus::appendSample(out, "weather_http_compression_output_bytes_total", "counter",
+                             "Body bytes after compression.", static_cast<double>(compressedOut));
+    prometheus::appendSample(out, "weather_http_compression_ratio", "gauge",
+                             "Compressed size as a fraction of the original, since start.",
+                             compressedIn ? static_cast<double>(compressedOut) / compressedIn : 1.0);
+
+    const DatabaseMetrics& database = db.metrics();
+    const std::pair<const char*, const LatencyHistogram*> methods[] = {
+        { R"(method="createUser")", &database.createUser },
+        { R"(method="authenticateUser")", &database.authenticateUser },
+        { R"(method="forEachHistory")", &database.forEachHistory },
+        { R"(method="writeQueryLogs")", &database.writeQueryLogs },
+        { R"(method="readRollups")", &database.readRollups },
+        { R"(method="pruneQueryLogs")", &database.pruneQueryLogs },
+    };
+    prometheus::appendHeader(out, "weather_sqlite_duration_seconds", "histogram",
+                             "Time spent in Database methods that touch SQLite.");
+    for (const auto& method : methods) {
+        method.second->appendPrometheus(out, "weather_sqlite_duration_seconds", method.first);
+    }
+    prometheus::appendSample(out, "weather_query_logs_pruned_total", "counter",
+                             "History rows deleted by the retention policy.",
+                             static_cast<double>(database.prunedRows.load(std::memory_order_relaxed)));
+    reply.res.body().assign(out);
+}
+
+void HttpServer::handleTraceDump(const RequestContext&, Reply& reply) {
+    reply.res.body() = Tracer::instance().chromeTraceJson();
+}
+
+void HttpServer::handleCacheStats(const RequestContext&, Reply& reply) {
+    WeatherCacheStats stats = weather.stats();
+    reply.res.body() = nlohmann::json{
+        {"hits", stats.hits},
+        {"misses", stats.misses},
+        {"coalesced", stats.coalesced},
+        {"evictions", stats.evictions},
+        {"shed", stats.shed},
+        {"staleServed", stats.staleServed},
+        {"size", stats.size}
+    }.dump();
+}
+
+// I write min/max/avg of one measure, or null when nothing was measured.
+template <class String>
+static void appendRange(String& out, long long readings, double min, double max, double sum) {
+    if (readings == 0) {
+        out += "null";
+        return;
+    }
+    out.push_back('{');
+    json_writer::appendKey(out, "min");
+    json_writer::appendNumber(out, min);
+    out.push_back(',');
+    json_writer::appendKey(out, "max");
+    json_writer::appendNumber(out, max);
+    out.push_back(',');
+    json_writer::appendKey(out, "avg");
+    json_writer::appendNumber(out, sum / static_cast<double>(readings));
+    out.push_back('}');
+}
+
+template <class String>
+static void appendRollup(String& out, const CityRollup& r) {
+    out.push_back('{');
+    json_writer::appendKey(out, "city");
+    json_writer::appendString(out, r.city);
+    if (!r.hour.empty()) {
+        out.push_back(',');
+        json_writer::appendKey(out, "hour");
+        json_writer::appendString(out, r.hour);
+    }
+    out.push_back(',');
+    json_writer::appendKey(out, "queries");
+    json_writer::appendNumber(out, r.queries);
+    out.push_back(',');
+    json_writer::appendKey(out, "readings");
+    json_writer::appendNumber(out, r.readings);
+    out.push_back(',');
+    json_writer::appendKey(out, "tempC");
+    appendRange(out, r.readings, r.tempMin, r.tempMax, r.tempSum);
+    out.push_back(',');
+    json_writer::appendKey(out, "windKph");
+    appendRange(out, r.readings, r.windMin, r.windMax, r.windSum);
+    out.push_back('}');
+}
+
+void HttpServer::handleCityStats(const RequestContext& ctx, Reply& reply) {
+    static constexpr std::size_t kMaxHours = 24 * 31;
+    static constexpr std::size_t kMaxCities = 1000;
+
+    std::string value;
+    std::size_t hours = 24;
+    if (queryParam(ctx.query, "hours", value)) {
+        hours = std::clamp<std::size_t>(std::stoul(value), 1, kMaxHours);
+    }
+
+    ArenaString& out = reply.res.body();
+    std::string city;
+    if (queryParam(ctx.query, "city", city)) {
+        out = "{";
+        json_writer::appendKey(out, "city");
+        json_writer::appendString(out, normalizeCity(city));
+        out.push_back(',');
+        json_writer::appendKey(out, "hourly");
+        out.push_back('[');
+        bool first = true;
+        for (const auto& row : db.cityHours(city, hours)) {
+            if (!first) out.push_back(',');
+            first = false;
+            appendRollup(out, row);
+        }
+        out += "]}";
+        return;
+    }
+
+    std::size_t limit = 20;
+    if (queryParam(ctx.query, "limit", value)) {
+        limit = std::clamp<std::size_t>(std::stoul(value), 1, kMaxCities);
+    }
+
+    out = "{";
+    json_writer::appendKey(out, "hours");
+    json_writer::appendNumber(out, static_cast<long long>(hours));
+    out.push_back(',');
+    json_writer::appendKey(out, "cities");
+    out.push_back('[');
+    bool first = true;
+    for (const auto& row : db.topCities(hours, limit)) {
+        if (!first) out.push_back(',');
+        first = false;
+        appendRollup(out, row);
+    }
+    out += "]}";
+}
+
+// I write one history row as a JSON object without building a DOM.
+template <class String>
+static void appendHistoryRow(String& out, const HistoryRowView& row) {
+    out += '{';
+    json_writer::appendKey(out, "timestamp");
+    json_writer::appendString(out, row.timestamp);
+    out += ',';
+    json_writer::appendKey(out, "city");
+    json_writer::appendString(out, row.city);
+    out += ',';
+    json_writer::appendKey(out, "summary");
+    json_writer::appendString(out, row.summary);
+    out += '}';
+}
+
+// I accept ?limit=N&before=<cursor> for one page (the next cursor comes
+// back in X-Next-Cursor when more rows may exist), or ?stream=1 to get
+// the whole history as one chunked JSON array with constant memory.
+void HttpServer::handleHistory(const RequestContext& ctx, Reply& reply) {
+    Session session;
+    if (!sessions.validateToken(getBearerToken(ctx.req), session)) {
+        reply.res.result(http::status::unauthorized);
+        reply.res.body() = R"({"error":"unauthorized"})";
+        return;
+    }
+
+    Response& res = reply.res;
+    int userId = session.userId;
+    std::string_view query = ctx.query;
+
+    std::string value;
+    std::size_t limit = options.historyPageSize;
+    if (queryParam(query, "limit", value)) {
+        limit = std::min<std::size_t>(std::stoul(value), options.historyMaxPageSize);
+    }
+
+    HistoryCursor before;
+    if (queryParam(query, "before", value) && !HistoryCursor::parse(value, before)) {
+        throw std::invalid_argument("invalid cursor");
+    }
+
+    // I tag history by the user's newest row and the retention pass count;
+    // while rows are still queued there is no tag and the page is read.
+    HistoryVersion version;
+    if (db.historyVersion(userId, version)) {
+        char etag[64];
+        std::snprintf(etag, sizeof(etag), "W/\"h%lld.%llu\"", version.lastId,
+                      static_cast<unsigned long long>(version.pruned));
+        if (notModified(ctx.req, res, etag)) return;
+    }
+
+    // I flush the user's queued rows once, for the page or the whole
+    // stream; later chunks read without waiting on the writer.
+    db.flushHistory(userId);
+
+    if (queryParam(query, "stream", value) && value == "1") {
+        // I keep only the keyset cursor between chunks; each chunk is a
+        // fresh page read straight from SQLite into the chunk buffer,
+        // so no connection or cursor is held while the socket drains.
+        struct StreamState {
+            HistoryCursor cursor;
+            bool first = true;
+        };
+        auto state = std::make_shared<StreamState>();
+        state->cursor = before;
+        std::size_t chunkRows = options.historyStreamChunkRows;
+
+        reply.stream = [this, userId, state, chunkRows](std::string& chunk) {
+            if (state->first) chunk += '[';
+
+            std::size_t rows = db.forEachHistory(userId, chunkRows, state->cursor,
+                [&](const HistoryRowView& row) {
+                    if (!state->first) chunk += ',';
+                    state->first = false;
+                    appendHistoryRow(chunk, row);
+                    // I copy the cursor while the row view is still valid.
+                    state->cursor.timestamp.assign(row.timestamp.data(), row.timestamp.size());
+                    state->cursor.id = row.id;
+                });
+
+            state->first = false;
+            if (rows < chunkRows) {
+                chunk += ']';
+                return false;
+            }
+            return true;
+        };
+        return;
+    }
+
+    // I keep the last row's position in the arena too. The callback only
+    // captures body and last, which fits std::function's inline storage.
+    ArenaString& body = res.body();
+    struct {
+        ArenaString timestamp;
+        long long id = 0;
+    } last{ ArenaString(body.get_allocator()) };
+
+    body += '[';
+    std::size_t rows = db.forEachHistory(userId, limit, before, [&](const HistoryRowView& row) {
+        if (body.size() > 1) body += ',';
+        appendHistoryRow(body, row);
+        last.timestamp.assign(row.timestamp.data(), row.timestamp.size());
+        last.id = row.id;
+    });
+    body += ']';
+
+    if (rows == limit && limit > 0) {
+        // Same "<timestamp>|<id>" form as HistoryCursor::toString().
+        char id[24];
+        int n = std::snprintf(id, sizeof(id), "|%lld", last.id);
+        last.timestamp.append(id, static_cast<std::size_t>(n));
+        res.set("X-Next-Cursor", beast::string_view(last.timestamp.data(), last.timestamp.size()));
     }
 }
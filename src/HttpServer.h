@@ -1,9 +1,107 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+#include <boost/asio.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
 
 #include "Database.h"
 #include "AuthService.h"
 #include "SessionManager.h"
+#include "WeatherCache.h"
+#include "WeatherStreamHub.h"
+#include "Metrics.h"
+#include "RateLimiter.h"
+#include "RequestArena.h"
+#include "ResponseCompressor.h"
+#include "Router.h"
+#include "Tracer.h"
+
+// I group tunables in one struct so adding a knob does not
+// ripple through every constructor call site.
+struct ServerOptions {
+    // I run the accept loop and all socket I/O on this many threads.
+    // Zero means one per hardware core.
+    unsigned ioThreads = 0;
+
+    // I run request handlers (SQLite, upstream HTTPS) on a separate pool
+    // so a slow handler never stalls socket I/O for other connections.
+    // Zero means four per I/O thread, since handlers mostly block on I/O.
+    unsigned workerThreads = 0;
+
+    // I close keep-alive connections that sit idle between requests
+    // for longer than this, so held sockets stay bounded.
+    std::chrono::seconds idleTimeout{15};
+
+    // I close a connection after this many requests so one client
+    // cannot pin a socket (and its strand) indefinitely.
+    unsigned maxRequestsPerConnection = 1000;
+
+    // I stop reading pipelined requests once this many are queued
+    // on one connection, which bounds per-connection memory.
+    unsigned pipelineLimit = 16;
+
+    // I page /history by default and cap how large a page may be,
+    // so one request never loads a user's whole history.
+    std::size_t historyPageSize = 100;
+    std::size_t historyMaxPageSize = 1000;
+
+    // I write streamed /history responses in chunks of this many rows.
+    std::size_t historyStreamChunkRows = 256;
+
+    // I cap POST /weather/batch at this many cities per request...
+    std::size_t batchMaxCities = 50;
+
+    // ...fetch at most this many of them at once...
+    unsigned batchParallelism = 8;
+
+    // ...and answer once this much time has passed, reporting the
+    // cities that are still outstanding as timed out.
+    std::chrono::milliseconds batchDeadline{5000};
+
+    // I refresh every city with /weather/stream subscribers this often
+    // (through the cache, so upstream sees at most one call per TTL)...
+    std::chrono::seconds streamRefresh{30};
+
+    // ...and drop a subscriber once this many events wait to be sent.
+    std::size_t streamQueueLimit = 8;
+
+    // I compress bodies of at least this many bytes (and every chunked
+    // body) when the client accepts gzip or deflate; smaller ones cost
+    // more CPU than they save on the wire.
+    std::size_t compressMinBytes = 1024;
+
+    // I use this zlib level (1 fastest .. 9 smallest); 0 turns compression off.
+    int compressionLevel = 6;
+
+    // I rate-limit requests per session token and per client address
+    // before they reach the worker pool; both are token buckets, and a
+    // zero rate turns either off.
+    RateLimitOptions tokenRateLimit{ 10.0, 20.0 };
+    RateLimitOptions ipRateLimit{ 50.0, 100.0 };
+
+    // I shed new requests with 503 while requests wait longer than this
+    // for a worker on average; zero turns shedding off.
+    std::chrono::milliseconds queueBudget{500};
+
+    SessionOptions sessions;
+
+    // I sample requests into per-thread trace buffers (off by default).
+    TracerOptions tracing;
+};
+
+// I parse requests into, and build responses in, a per-request arena
+// (see RequestArena): header fields and bodies use its allocator.
+using ArenaFields = boost::beast::http::basic_fields<ArenaAllocator>;
+using ArenaStringBody = boost::beast::http::basic_string_body<char, std::char_traits<char>, ArenaAllocator>;
 
 // I keep HttpServer focused on request routing and coordination,
 // not business logic or persistence.
@@ -11,20 +109,180 @@ class HttpServer {
 public:
     // I inject all dependencies so ownership and lifetimes
     // are managed by the application, not the server.
-    HttpServer(const std::string& address, int port, Database& db, AuthService& auth);
+    HttpServer(const std::string& address, int port, Database& db, AuthService& auth,
+               WeatherCache& weather, const ServerOptions& options = ServerOptions{});
 
-    // I run the server in a blocking loop to keep control flow explicit.
+    // I block the calling thread until the server is stopped
+    // (SIGINT/SIGTERM or stop()), while I/O runs on a thread pool.
     void run();
 
+    // I allow a clean shutdown from any thread.
+    void stop();
+
 private:
+    class Connection;
+
+    using Request = boost::beast::http::request<ArenaStringBody, ArenaFields>;
+    using Response = boost::beast::http::response<ArenaStringBody, ArenaFields>;
+
+    // I let a handler return a body producer instead of a finished body.
+    // The connection calls it on the worker pool, writes each chunk it
+    // fills as HTTP chunked encoding, and stops once it returns false.
+    using ChunkSource = std::function<bool(std::string& chunk)>;
+
+    // I pair the response head (and body, when not streaming)
+    // with an optional chunk source. A non-empty subscribeCity turns
+    // the connection into a Server-Sent Events stream for that city
+    // once the head is written.
+    struct Reply {
+        Response res;
+        ChunkSource stream;
+        std::string subscribeCity;
+    };
+
+    // I give handlers the already split target and captured params
+    // so none of them re-parses the URL.
+    struct RequestContext {
+        const Request& req;
+        std::string_view path;
+        std::string_view query;
+        RouteParams params;
+    };
+
+    using Handler = void (HttpServer::*)(const RequestContext& ctx, Reply& reply);
+
+    // I route either to a handler (run on the worker pool) or to a
+    // pre-serialized response (written straight from the I/O thread).
+    struct RouteTarget {
+        Handler handler = nullptr;
+        const StaticResponse* fixed = nullptr;
+        LatencyHistogram* latency = nullptr;
+        const char* traceName = "";
+    };
+
+    // I own one latency histogram per route, labelled for /metrics.
+    struct RouteStats {
+        RouteStats(std::string text, std::string name)
+            : labels(std::move(text)), traceName(std::move(name)) {}
+
+        std::string labels;
+        std::string traceName;
+        LatencyHistogram latency;
+    };
+
+    // I keep accepting asynchronously so a new client never waits on another.
+    void doAccept();
+
+    // I build the route table and the static responses once at startup.
+    void buildRoutes();
+
+    // I register a route together with its latency histogram.
+    void addRoute(boost::beast::http::verb method, std::string_view pattern, RouteTarget target);
+
+    // I return the ready-made bytes for requests that need no handler
+    // (CORS preflight, /health), or nullptr.
+    const StaticResponse* findStaticResponse(const Request& req) const;
+
+    // I decide on the I/O thread whether a request may queue for a
+    // worker: nullptr admits it, otherwise I return the 429 or 503 to
+    // send instead. Checks are cheap and never block.
+    const StaticResponse* admit(const Request& req, const std::string& clientAddress);
+
+    // I track the worker queue: called when a request is posted, and
+    // when a worker picks it up, with how long it waited.
+    void noteQueued() { queuedRequests.fetch_add(1, std::memory_order_relaxed); }
+    void noteDequeued(std::chrono::steady_clock::duration waited);
+
+    // I route a parsed request to its handler and build the response
+    // in the request's arena. This runs on the worker pool and may block.
+    Reply handleRequest(const Request& req);
+
+    // I compress the reply body (or wrap its chunk source) when the
+    // request accepts a coding and the body is worth it.
+    void compressReply(const Request& req, Reply& reply);
+
+    void handleRegister(const RequestContext& ctx, Reply& reply);
+    void handleLogin(const RequestContext& ctx, Reply& reply);
+    void handleLogout(const RequestContext& ctx, Reply& reply);
+    void handleWeather(const RequestContext& ctx, Reply& reply);
+
+    // I look up many cities concurrently on the fan-out pool.
+    void handleWeatherBatch(const RequestContext& ctx, Reply& reply);
+
+    // I subscribe the connection to a city's updates as Server-Sent Events.
+    void handleWeatherStream(const RequestContext& ctx, Reply& reply);
+    void handleCacheStats(const RequestContext& ctx, Reply& reply);
+
+    // I report per-city query counts and temperature/wind ranges from
+    // the hourly roll-ups (?hours=, ?limit=, or ?city= for hourly rows).
+    void handleCityStats(const RequestContext& ctx, Reply& reply);
+
+    // I expose counters and latency histograms in Prometheus text format.
+    void handleMetrics(const RequestContext& ctx, Reply& reply);
+
+    // I return the buffered request traces as Chrome trace_event JSON.
+    void handleTraceDump(const RequestContext& ctx, Reply& reply);
+
+    // I write a trace file whenever SIGUSR1 arrives (POSIX only).
+    void armTraceSignal(boost::asio::signal_set& signals);
+
+    // I serve one page of history, or the whole history as a chunked stream.
+    void handleHistory(const RequestContext& ctx, Reply& reply);
+
     // I store address and port explicitly to avoid hidden configuration.
     std::string address;
     int port;
+    ServerOptions options;
 
     // I hold references to shared services instead of owning them.
     Database& db;
     AuthService& auth;
+    WeatherCache& weather;
 
     // I keep session state local to the server boundary.
     SessionManager sessions;
+
+    Router<RouteTarget> router;
+    StaticResponse healthResponse;
+    StaticResponse preflightResponse;
+    StaticResponse tokenLimitedResponse;
+    StaticResponse ipLimitedResponse;
+    StaticResponse overloadedResponse;
+    StaticResponse badRequestResponse;
+    StaticResponse tooLargeResponse;
+
+    RateLimiter tokenLimiter;
+    RateLimiter ipLimiter;
+
+    // I cap traces forced with X-Trace per client address, so one client
+    // cannot flush the sampled spans out of the per-thread buffers.
+    RateLimiter forcedTraceLimiter{ RateLimitOptions{ 1.0, 5.0 } };
+
+    // I keep the worker queue depth and a moving average of how long
+    // requests waited in it (alpha 1/8), both lock-free.
+    std::atomic<std::int64_t> queuedRequests{0};
+    std::atomic<std::int64_t> queueDelayNanos{0};
+    std::atomic<std::uint64_t> shedRequests{0};
+
+    // I keep route stats in a deque so their addresses stay stable.
+    std::deque<RouteStats> routeStats;
+    LatencyHistogram* preflightLatency = nullptr;
+    LatencyHistogram* unmatchedLatency = nullptr;
+
+    CompressionMetrics compression;
+
+    std::atomic<std::int64_t> openConnections{0};
+    std::atomic<std::uint64_t> acceptedConnections{0};
+
+    // I share one io_context across all I/O threads and give every
+    // connection its own strand, so handlers of one socket never race.
+    boost::asio::io_context ioc;
+    boost::asio::ip::tcp::acceptor acceptor;
+    boost::asio::thread_pool workers;
+
+    // I run batch lookups on their own pool: a handler that waits for
+    // work queued behind itself on the worker pool could deadlock it.
+    boost::asio::thread_pool fanout;
+
+    WeatherStreamHub streams;
 };
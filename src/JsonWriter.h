@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// I append JSON text straight into an output string so hot paths can
+// serialize rows without building an nlohmann::json DOM first. Any
+// std::basic_string<char> works, so a response body can be written in
+// place whatever allocator it uses.
+namespace json_writer {
+
+// I escape exactly what RFC 8259 requires and pass UTF-8 through untouched.
+template <class String>
+inline void appendString(String& out, std::string_view value) {
+    static const char* hex = "0123456789abcdef";
+    out.push_back('"');
+    for (char ch : value) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out.push_back(hex[c >> 4]);
+                    out.push_back(hex[c & 0x0F]);
+                } else {
+                    out.push_back(ch);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+// I write "key": so callers only add the value.
+template <class String>
+inline void appendKey(String& out, std::string_view key) {
+    appendString(out, key);
+    out.push_back(':');
+}
+
+template <class String>
+inline void appendNumber(String& out, long long value) {
+    char buf[24];
+    int n = std::snprintf(buf, sizeof(buf), "%lld", value);
+    out.append(buf, static_cast<std::size_t>(n));
+}
+
+template <class String>
+inline void appendNumber(String& out, double value) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.15g", value);
+    out.append(buf, static_cast<std::size_t>(n));
+}
+
+} // namespace json_writer
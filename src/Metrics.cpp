@@ -0,0 +1,140 @@
+#include "Metrics.h"
+
+#include <cmath>
+#include <cstdio>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int floorLog2(std::uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+int LatencyHistogram::bucketFor(std::chrono::nanoseconds elapsed) noexcept {
+    // I round up to whole microseconds; everything up to 1us is bucket 0.
+    std::int64_t ns = elapsed.count();
+    if (ns <= 1000) return 0;
+    std::uint64_t us = static_cast<std::uint64_t>(ns + 999) / 1000;
+
+    // 2^k < us <= 2^(k+1); the octave is split at 1.5 * 2^k.
+    int k = floorLog2(us - 1);
+    int bucket = 1 + 2 * k + (2 * us > (3ull << k) ? 1 : 0);
+    return bucket < kBuckets - 1 ? bucket : kBuckets - 1;
+}
+
+double LatencyHistogram::upperBoundSeconds(int bucket) {
+    if (bucket <= 0) return 1e-6;
+    if (bucket >= kBuckets - 1) return INFINITY;
+    int k = (bucket - 1) / 2;
+    double base = std::ldexp(1.0, k);
+    return ((bucket - 1) % 2 == 0 ? 1.5 * base : 2.0 * base) * 1e-6;
+}
+
+std::size_t LatencyHistogram::stripeForThisThread() noexcept {
+    // I hand stripes out round robin the first time a thread records.
+    static std::atomic<std::size_t> nextStripe{0};
+    thread_local std::size_t stripe = nextStripe.fetch_add(1, std::memory_order_relaxed) % kStripes;
+    return stripe;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds elapsed) noexcept {
+    Stripe& stripe = stripes[stripeForThisThread()];
+    stripe.buckets[bucketFor(elapsed)].fetch_add(1, std::memory_order_relaxed);
+    stripe.sumNanos.fetch_add(static_cast<std::uint64_t>(elapsed.count()), std::memory_order_relaxed);
+}
+
+void LatencyHistogram::appendPrometheus(std::string& out, std::string_view name,
+                                        std::string_view labels) const {
+    std::uint64_t counts[kBuckets] = {};
+    std::uint64_t sumNanos = 0;
+    for (const auto& stripe : stripes) {
+        for (int b = 0; b < kBuckets; ++b) counts[b] += stripe.buckets[b].load(std::memory_order_relaxed);
+        sumNanos += stripe.sumNanos.load(std::memory_order_relaxed);
+    }
+
+    std::string prefix(name);
+    std::string separator = labels.empty() ? "" : ",";
+    char line[64];
+
+    // I emit cumulative counts, as Prometheus expects.
+    std::uint64_t cumulative = 0;
+    for (int b = 0; b < kBuckets; ++b) {
+        cumulative += counts[b];
+        double bound = upperBoundSeconds(b);
+        if (std::isinf(bound)) std::snprintf(line, sizeof(line), "+Inf");
+        else std::snprintf(line, sizeof(line), "%.9g", bound);
+
+        out += prefix + "_bucket{" + std::string(labels) + separator + "le=\"" + line + "\"} " +
+               std::to_string(cumulative) + "\n";
+    }
+
+    std::string suffix = labels.empty() ? " " : "{" + std::string(labels) + "} ";
+    std::snprintf(line, sizeof(line), "%.9g", static_cast<double>(sumNanos) / 1e9);
+    out += prefix + "_sum" + suffix + line + "\n";
+    out += prefix + "_count" + suffix + std::to_string(cumulative) + "\n";
+}
+
+double LatencyHistogram::quantileSeconds(double q, std::uint64_t& count) const {
+    std::uint64_t counts[kBuckets] = {};
+    count = 0;
+    for (const auto& stripe : stripes) {
+        for (int b = 0; b < kBuckets; ++b) counts[b] += stripe.buckets[b].load(std::memory_order_relaxed);
+    }
+    for (int b = 0; b < kBuckets; ++b) count += counts[b];
+    if (count == 0) return 0.0;
+
+    // I look for the first bucket whose cumulative count reaches rank.
+    double rank = std::ceil(q * static_cast<double>(count));
+    std::uint64_t cumulative = 0;
+    for (int b = 0; b < kBuckets; ++b) {
+        cumulative += counts[b];
+        if (static_cast<double>(cumulative) >= rank) return upperBoundSeconds(b);
+    }
+    return upperBoundSeconds(kBuckets - 1);
+}
+
+namespace prometheus {
+
+void appendHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void appendSample(std::string& out, std::string_view name, std::string_view type,
+                  std::string_view help, double value) {
+    appendHeader(out, name, type, help);
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.17g", value);
+    out += name;
+    out += ' ';
+    out += text;
+    out += '\n';
+}
+
+std::string escapeLabel(std::string_view value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '"') out += "\\\"";
+        else if (c == '\n') out += "\\n";
+        else out.push_back(c);
+    }
+    return out;
+}
+
+} // namespace prometheus
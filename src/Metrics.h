@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// I record latencies into fixed log-linear buckets (HDR-style, two per
+// power of two from 1us to about 2 minutes), so recording is a bucket
+// computation plus two relaxed atomic adds and never allocates or locks.
+// Counts are striped across cache lines by thread to keep busy threads
+// from contending on the same counters.
+class LatencyHistogram {
+public:
+    // Bucket 0 holds <= 1us, the last one everything above the largest bound.
+    static constexpr int kOctaves = 27;
+    static constexpr int kBuckets = 2 * kOctaves + 2;
+
+    void record(std::chrono::nanoseconds elapsed) noexcept;
+
+    // I report the bucket an elapsed time falls into (exposed for benchmarks).
+    static int bucketFor(std::chrono::nanoseconds elapsed) noexcept;
+
+    // I return the inclusive upper bound of a bucket in seconds.
+    static double upperBoundSeconds(int bucket);
+
+    // I append one Prometheus histogram series (buckets, _sum, _count).
+    // The caller writes the # HELP / # TYPE header once per family.
+    // labels is the text inside {}, e.g. route="/history"; may be empty.
+    void appendPrometheus(std::string& out, std::string_view name, std::string_view labels) const;
+
+    // I estimate quantile q (0..1) as the upper bound of the bucket it
+    // falls into, in seconds; count is the number of samples it is
+    // based on. Zero when nothing was recorded.
+    double quantileSeconds(double q, std::uint64_t& count) const;
+
+private:
+    static constexpr std::size_t kStripes = 4;
+
+    struct alignas(64) Stripe {
+        std::atomic<std::uint64_t> buckets[kBuckets] = {};
+        std::atomic<std::uint64_t> sumNanos{0};
+    };
+
+    static std::size_t stripeForThisThread() noexcept;
+
+    Stripe stripes[kStripes];
+};
+
+// I time a scope into a histogram (which may be null).
+class ScopedLatency {
+public:
+    explicit ScopedLatency(LatencyHistogram* target)
+        : histogram(target), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedLatency() {
+        if (histogram) histogram->record(std::chrono::steady_clock::now() - start);
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    LatencyHistogram* histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+// I write the Prometheus text exposition format by hand; it is simple
+// enough that a client library would add more than it saves.
+namespace prometheus {
+
+void appendHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help);
+
+// I write a single unlabeled sample with its header.
+void appendSample(std::string& out, std::string_view name, std::string_view type,
+                  std::string_view help, double value);
+
+// I escape a label value (backslash, quote, newline).
+std::string escapeLabel(std::string_view value);
+
+} // namespace prometheus
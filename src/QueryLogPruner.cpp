@@ -0,0 +1,47 @@
+#include "QueryLogPruner.h"
+
+#include <utility>
+
+QueryLogPruner::QueryLogPruner(PruneBatch batch, Compact compactFile, const QueryLogRetention& opts)
+    : pruneBatch(std::move(batch)), compact(std::move(compactFile)), retention(opts) {
+    if (retention.batchSize == 0) retention.batchSize = 1;
+    thread = std::thread([this] { run(); });
+}
+
+QueryLogPruner::~QueryLogPruner() {
+    stop();
+}
+
+void QueryLogPruner::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) return;
+        stopping = true;
+    }
+    wake.notify_one();
+    if (thread.joinable()) thread.join();
+}
+
+bool QueryLogPruner::sleepFor(std::chrono::milliseconds d) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return !wake.wait_for(lock, d, [this] { return stopping; });
+}
+
+void QueryLogPruner::run() {
+    do {
+        try {
+            // I keep deleting while batches come back full; each one is a
+            // separate short write so the log writer can interleave.
+            std::size_t deleted = 0;
+            do {
+                deleted = pruneBatch();
+            } while (deleted >= retention.batchSize && sleepFor(retention.batchPause));
+
+            compact();
+        }
+        catch (...) {
+            // I retry on the next pass rather than kill the thread;
+            // rows that were not deleted are simply still there.
+        }
+    } while (sleepFor(retention.interval));
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// I keep retention tunables together so Database can expose them as one knob.
+struct QueryLogRetention {
+    // I keep rows younger than this; zero keeps everything and starts no thread.
+    std::chrono::seconds maxAge{0};
+
+    // I delete at most this many rows per statement, so the writer lock
+    // is only ever held for one small batch...
+    std::size_t batchSize = 500;
+
+    // ...and yield this long between batches so logging keeps flowing.
+    std::chrono::milliseconds batchPause{50};
+
+    // I start a pass this often; the first one runs right after startup.
+    std::chrono::seconds interval{600};
+
+    // I return at most this many free pages to the OS after each pass.
+    std::size_t vacuumPages = 1024;
+
+    // I append pruned rows here as gzip-compressed JSON lines before
+    // deleting them. Empty disables the archive.
+    std::string archivePath;
+};
+
+// I enforce retention off the request path: a background thread wakes up
+// every interval, deletes expired rows batch by batch through a callback,
+// then compacts the file once the backlog is gone.
+class QueryLogPruner {
+public:
+    // I delete one batch and return how many rows went; a short batch
+    // means the pass is done.
+    using PruneBatch = std::function<std::size_t()>;
+    using Compact = std::function<void()>;
+
+    QueryLogPruner(PruneBatch pruneBatch, Compact compact, const QueryLogRetention& retention);
+
+    // I finish the batch in progress, if any, and join the thread.
+    ~QueryLogPruner();
+
+    QueryLogPruner(const QueryLogPruner&) = delete;
+    QueryLogPruner& operator=(const QueryLogPruner&) = delete;
+
+    void stop();
+
+private:
+    void run();
+
+    // I sleep for d unless stop() is called first; false means stopping.
+    bool sleepFor(std::chrono::milliseconds d);
+
+    PruneBatch pruneBatch;
+    Compact compact;
+    QueryLogRetention retention;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::thread thread;
+};
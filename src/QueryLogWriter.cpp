@@ -0,0 +1,106 @@
+#include "QueryLogWriter.h"
+
+#include <algorithm>
+#include <utility>
+
+QueryLogWriter::QueryLogWriter(Sink writeBatch, const QueryLogOptions& opts)
+    : sink(std::move(writeBatch)), options(opts) {
+    queue.reserve(options.batchSize);
+    thread = std::thread([this] { run(); });
+}
+
+QueryLogWriter::~QueryLogWriter() {
+    stop();
+}
+
+void QueryLogWriter::enqueue(QueryLogEntry entry) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // I apply backpressure instead of dropping rows or growing unbounded.
+    wakeProducers.wait(lock, [this] { return stopping || queue.size() < options.capacity; });
+    if (stopping) return;
+
+    queue.push_back(std::move(entry));
+    ++enqueued;
+
+    if (queue.size() >= options.batchSize) wakeWriter.notify_one();
+}
+
+void QueryLogWriter::enqueue(std::vector<QueryLogEntry> entries) {
+    if (entries.empty()) return;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // I wait for room for the whole group; a group larger than the
+    // capacity only waits for an empty queue so it cannot block forever.
+    std::size_t needed = std::min(entries.size(), options.capacity);
+    wakeProducers.wait(lock, [this, needed] {
+        return stopping || queue.size() + needed <= options.capacity;
+    });
+    if (stopping) return;
+
+    for (auto& entry : entries) queue.push_back(std::move(entry));
+    enqueued += entries.size();
+
+    if (queue.size() >= options.batchSize) wakeWriter.notify_one();
+}
+
+void QueryLogWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (written >= enqueued) return;
+
+    std::uint64_t target = enqueued;
+    flushRequested = true;
+    wakeWriter.notify_one();
+    wakeProducers.wait(lock, [this, target] { return written >= target; });
+}
+
+void QueryLogWriter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) return;
+        stopping = true;
+    }
+    wakeWriter.notify_one();
+    wakeProducers.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void QueryLogWriter::run() {
+    std::vector<QueryLogEntry> batch;
+    batch.reserve(options.batchSize);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        // I sleep until a batch fills up, a flush is requested, we are
+        // stopping, or the interval elapses with rows waiting.
+        wakeWriter.wait_for(lock, options.flushInterval, [this] {
+            return stopping || flushRequested || queue.size() >= options.batchSize;
+        });
+
+        if (queue.empty()) {
+            flushRequested = false;
+            if (stopping) break;
+            continue;
+        }
+
+        batch.swap(queue);
+        flushRequested = false;
+        lock.unlock();
+
+        // I let producers continue while the batch is being written.
+        wakeProducers.notify_all();
+        try {
+            sink(batch);
+        }
+        catch (...) {
+            // I drop a failed batch rather than kill the writer thread;
+            // query logging is best-effort, as it always was.
+        }
+        std::size_t count = batch.size();
+        batch.clear();
+
+        lock.lock();
+        written += count;
+        wakeProducers.notify_all();
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// I carry one pending query_logs row from the request thread to the writer.
+struct QueryLogEntry {
+    int userId;
+    std::string city;
+    std::string summary;
+
+    // I carry the typed reading when the lookup produced one, so the
+    // writer can update the hourly roll-ups without parsing summary.
+    bool hasReading = false;
+    double tempC = 0.0;
+    double windKph = 0.0;
+};
+
+// I keep writer tunables together so Database can expose them as one knob.
+struct QueryLogOptions {
+    // I block producers once this many rows are waiting (backpressure).
+    std::size_t capacity = 8192;
+
+    // I flush as soon as this many rows are queued...
+    std::size_t batchSize = 256;
+
+    // ...or at least this often while rows are waiting.
+    std::chrono::milliseconds flushInterval{100};
+};
+
+// I move query logging off the request path: producers append to a bounded
+// in-memory queue and a single background thread hands whole batches to
+// a sink, which writes each batch in one SQLite transaction.
+class QueryLogWriter {
+public:
+    using Sink = std::function<void(const std::vector<QueryLogEntry>&)>;
+
+    QueryLogWriter(Sink sink, const QueryLogOptions& options = QueryLogOptions{});
+
+    // I flush everything still queued before the thread exits.
+    ~QueryLogWriter();
+
+    QueryLogWriter(const QueryLogWriter&) = delete;
+    QueryLogWriter& operator=(const QueryLogWriter&) = delete;
+
+    // I return immediately unless the queue is full, in which case
+    // I wait for the writer to drain it.
+    void enqueue(QueryLogEntry entry);
+
+    // I queue several rows at once so they are guaranteed to land in the
+    // same batch, and therefore in the same transaction.
+    void enqueue(std::vector<QueryLogEntry> entries);
+
+    // I block until every row enqueued before this call has been written.
+    // This is cheap when nothing is pending.
+    void flush();
+
+    // I stop accepting rows, flush the remainder and join the thread.
+    void stop();
+
+private:
+    void run();
+
+    Sink sink;
+    QueryLogOptions options;
+
+    std::mutex mutex;
+    std::condition_variable wakeWriter;
+    std::condition_variable wakeProducers;
+
+    std::vector<QueryLogEntry> queue;
+    std::uint64_t enqueued = 0;
+    std::uint64_t written = 0;
+    bool flushRequested = false;
+    bool stopping = false;
+
+    std::thread thread;
+};
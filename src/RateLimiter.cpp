@@ -0,0 +1,77 @@
+#include "RateLimiter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+static std::int64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+RateLimiter::RateLimiter(const RateLimitOptions& opts) : options(opts) {
+    // I never let the burst be below one request, or nobody gets in.
+    options.burst = std::max(options.burst, 1.0);
+}
+
+bool RateLimiter::allow(std::string_view key) {
+    if (!enabled()) return true;
+
+    Shard& shard = shards[std::hash<std::string_view>{}(key) % kShardCount];
+    std::int64_t now = nowNanos();
+
+    // I look up through a per-thread copy of the key, whose capacity is
+    // reused, so checking a known client allocates nothing.
+    thread_local std::string lookup;
+    lookup.assign(key.data(), key.size());
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.buckets.find(lookup);
+    if (it == shard.buckets.end()) {
+        if (shard.buckets.size() >= shard.sweepAt) sweep(shard, now);
+        shard.buckets.emplace(lookup, Bucket{ options.burst - 1.0, now });
+        return true;
+    }
+
+    // I refill lazily from the time since this bucket was last touched.
+    Bucket& bucket = it->second;
+    double elapsed = static_cast<double>(now - bucket.updatedNanos) / 1e9;
+    bucket.tokens = std::min(options.burst, bucket.tokens + elapsed * options.perSecond);
+    bucket.updatedNanos = now;
+
+    if (bucket.tokens < 1.0) {
+        rejections.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    bucket.tokens -= 1.0;
+    return true;
+}
+
+void RateLimiter::sweep(Shard& shard, std::int64_t now) {
+    for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+        double elapsed = static_cast<double>(now - it->second.updatedNanos) / 1e9;
+        if (it->second.tokens + elapsed * options.perSecond >= options.burst) {
+            it = shard.buckets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // I sweep again only after the shard doubles, so a shard full of
+    // active clients does not rescan on every new key.
+    shard.sweepAt = std::max(kSweepThreshold, shard.buckets.size() * 2);
+}
+
+std::chrono::seconds RateLimiter::retryAfter() const {
+    if (!enabled()) return std::chrono::seconds(1);
+    return std::chrono::seconds(std::max<long long>(1, static_cast<long long>(std::ceil(1.0 / options.perSecond))));
+}
+
+std::size_t RateLimiter::trackedKeys() const {
+    std::size_t total = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.buckets.size();
+    }
+    return total;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// I describe one token bucket: a steady refill rate and the burst a
+// client may spend at once. A zero rate turns the limiter off.
+struct RateLimitOptions {
+    double perSecond = 0.0;
+    double burst = 0.0;
+};
+
+// I rate-limit by key (a session token, a client address) with one token
+// bucket per key. The buckets are sharded by key hash, so checks for
+// different clients rarely share a lock, and each check is a hash lookup
+// plus a little arithmetic. Full buckets carry no information, so idle
+// ones are swept as a shard grows.
+class RateLimiter {
+public:
+    explicit RateLimiter(const RateLimitOptions& options = RateLimitOptions{});
+
+    bool enabled() const { return options.perSecond > 0.0; }
+
+    // I take one token for key and return true, or return false when
+    // its bucket is empty. Always true when disabled.
+    bool allow(std::string_view key);
+
+    // I suggest how long a rejected client should wait, in whole
+    // seconds (at least 1): the time to refill one token.
+    std::chrono::seconds retryAfter() const;
+
+    std::uint64_t rejected() const { return rejections.load(std::memory_order_relaxed); }
+    std::size_t trackedKeys() const;
+
+private:
+    static constexpr std::size_t kShardCount = 16;
+
+    // I sweep a shard once it holds this many buckets.
+    static constexpr std::size_t kSweepThreshold = 4096;
+
+    struct Bucket {
+        double tokens;
+        std::int64_t updatedNanos;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, Bucket> buckets;
+        std::size_t sweepAt = kSweepThreshold;
+    };
+
+    // I drop buckets that have refilled completely (must hold the lock).
+    void sweep(Shard& shard, std::int64_t now);
+
+    RateLimitOptions options;
+    Shard shards[kShardCount];
+    std::atomic<std::uint64_t> rejections{0};
+};
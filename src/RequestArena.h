@@ -0,0 +1,82 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+
+// I allocate from a RequestArena; containers that take me keep using
+// the arena they were built with, however they are moved around.
+using ArenaAllocator = std::pmr::polymorphic_allocator<char>;
+using ArenaString = std::pmr::string;
+
+// I hand out all the memory one HTTP request needs (the parsed headers
+// and body, temporaries, the response and its serialized body) from a
+// single block, and take it back in one step when the connection moves
+// on to another request. Frees in between are no-ops.
+//
+// A request that outgrows the block spills over to the heap; the next
+// reset() grows the block to cover it (up to kMaxRetainedBytes), so a
+// connection settles at no heap allocations for its usual requests.
+//
+// I am not thread-safe: one thread at a time may allocate from me, and
+// the hand-off between threads must itself be synchronized.
+class RequestArena {
+public:
+    static constexpr std::size_t kInitialBytes = 8 * 1024;
+    static constexpr std::size_t kMaxRetainedBytes = 256 * 1024;
+
+    RequestArena() : blockSize(kInitialBytes), block(new std::byte[kInitialBytes]) {
+        monotonic.emplace(block.get(), blockSize, &overflow);
+    }
+
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &*monotonic; }
+    ArenaAllocator allocator() { return ArenaAllocator(resource()); }
+
+    // I release everything allocated since the last reset. Nothing that
+    // still holds arena memory may be used afterwards.
+    void reset() {
+        monotonic.reset();
+
+        std::size_t wanted = std::min(kMaxRetainedBytes, blockSize + overflow.spilled);
+        if (wanted > blockSize) {
+            block.reset(new std::byte[wanted]);
+            blockSize = wanted;
+        }
+        overflow.spilled = 0;
+        monotonic.emplace(block.get(), blockSize, &overflow);
+    }
+
+    std::size_t capacity() const { return blockSize; }
+
+private:
+    // I pass spill-over allocations to the heap and keep count of them,
+    // so reset() knows how much larger the block has to be.
+    class Overflow : public std::pmr::memory_resource {
+    public:
+        std::size_t spilled = 0;
+
+    private:
+        void* do_allocate(std::size_t size, std::size_t alignment) override {
+            spilled += size;
+            return std::pmr::new_delete_resource()->allocate(size, alignment);
+        }
+
+        void do_deallocate(void* p, std::size_t size, std::size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    std::size_t blockSize;
+    std::unique_ptr<std::byte[]> block;
+    Overflow overflow;
+    std::optional<std::pmr::monotonic_buffer_resource> monotonic;
+};
@@ -0,0 +1,165 @@
+#include "ResponseCompressor.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <zlib.h>
+
+// I choose the zlib wrapper through windowBits: +16 writes a gzip
+// header and trailer, plain 15 the zlib one.
+static int windowBitsFor(ContentCoding coding) {
+    return coding == ContentCoding::gzip ? 15 + 16 : 15;
+}
+
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) ==
+                      std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+ContentCoding negotiateContentCoding(std::string_view acceptEncoding) {
+    double gzipQ = -1.0, deflateQ = -1.0, anyQ = -1.0;
+
+    while (!acceptEncoding.empty()) {
+        auto comma = acceptEncoding.find(',');
+        std::string_view item = acceptEncoding.substr(0, comma);
+        acceptEncoding = comma == std::string_view::npos ? std::string_view{}
+                                                         : acceptEncoding.substr(comma + 1);
+
+        // I read "coding;q=0.5"; other parameters are ignored.
+        auto semi = item.find(';');
+        std::string_view coding = trim(item.substr(0, semi));
+        double q = 1.0;
+        if (semi != std::string_view::npos) {
+            std::string_view param = trim(item.substr(semi + 1));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                q = std::strtod(std::string(param.substr(2)).c_str(), nullptr);
+            }
+        }
+
+        if (equalsIgnoreCase(coding, "gzip") || equalsIgnoreCase(coding, "x-gzip")) gzipQ = q;
+        else if (equalsIgnoreCase(coding, "deflate")) deflateQ = q;
+        else if (coding == "*") anyQ = q;
+    }
+
+    if (gzipQ < 0) gzipQ = anyQ;
+    if (deflateQ < 0) deflateQ = anyQ;
+    if (gzipQ <= 0 && deflateQ <= 0) return ContentCoding::identity;
+    return gzipQ >= deflateQ ? ContentCoding::gzip : ContentCoding::deflate;
+}
+
+const char* contentCodingName(ContentCoding coding) {
+    switch (coding) {
+        case ContentCoding::gzip:    return "gzip";
+        case ContentCoding::deflate: return "deflate";
+        default:                     return "identity";
+    }
+}
+
+// I hold one initialized deflate stream. Level and coding are fixed for
+// its lifetime; reset() makes it ready for the next body.
+struct Deflater {
+    z_stream zs{};
+    bool ready = false;
+    int level = 0;
+
+    ~Deflater() {
+        if (ready) deflateEnd(&zs);
+    }
+
+    bool init(ContentCoding coding, int lvl) {
+        if (ready && level == lvl) return deflateReset(&zs) == Z_OK;
+        if (ready) deflateEnd(&zs);
+
+        zs = z_stream{};
+        ready = deflateInit2(&zs, lvl, Z_DEFLATED, windowBitsFor(coding), 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        level = lvl;
+        return ready;
+    }
+};
+
+static void record(CompressionMetrics* metrics, std::chrono::steady_clock::time_point start,
+                   std::size_t in, std::size_t out) {
+    if (!metrics) return;
+    metrics->latency.record(std::chrono::steady_clock::now() - start);
+    metrics->bytesIn.fetch_add(in, std::memory_order_relaxed);
+    metrics->bytesOut.fetch_add(out, std::memory_order_relaxed);
+}
+
+bool compressBody(std::string_view in, ContentCoding coding, int level, std::string& out,
+                  CompressionMetrics* metrics) {
+    if (coding == ContentCoding::identity) return false;
+    auto start = std::chrono::steady_clock::now();
+
+    thread_local Deflater gzipDeflater;
+    thread_local Deflater zlibDeflater;
+    Deflater& d = coding == ContentCoding::gzip ? gzipDeflater : zlibDeflater;
+    if (!d.init(coding, level)) return false;
+
+    // I size the output once with deflateBound (plus the gzip header and
+    // trailer it does not count), so one Z_FINISH call always completes.
+    // The buffer is per thread and trades places with out, so a caller
+    // that keeps out around compresses without allocating.
+    thread_local std::string compressed;
+    compressed.resize(deflateBound(&d.zs, static_cast<uLong>(in.size())) + 18);
+
+    d.zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    d.zs.avail_in = static_cast<uInt>(in.size());
+    d.zs.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+    d.zs.avail_out = static_cast<uInt>(compressed.size());
+    if (deflate(&d.zs, Z_FINISH) != Z_STREAM_END) return false;
+
+    compressed.resize(d.zs.total_out);
+    record(metrics, start, in.size(), compressed.size());
+    out.swap(compressed);
+    return true;
+}
+
+struct StreamCompressor::State {
+    Deflater deflater;
+};
+
+StreamCompressor::StreamCompressor(ContentCoding coding, int level, CompressionMetrics* m)
+    : state(std::make_unique<State>()), metrics(m) {
+    if (!state->deflater.init(coding, level)) throw std::runtime_error("deflateInit failed");
+}
+
+StreamCompressor::~StreamCompressor() = default;
+
+void StreamCompressor::write(std::string_view in, bool last, std::string& out) {
+    auto start = std::chrono::steady_clock::now();
+    z_stream& zs = state->deflater.zs;
+    std::size_t before = out.size();
+
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+
+    // I grow out until zlib stops filling it: with Z_NO_FLUSH that means
+    // all input is consumed, with Z_FINISH that the stream has ended.
+    int flush = last ? Z_FINISH : Z_NO_FLUSH;
+    for (;;) {
+        std::size_t used = out.size();
+        out.resize(used + std::max<std::size_t>(in.size() / 2, 16 * 1024));
+        zs.next_out = reinterpret_cast<Bytef*>(&out[used]);
+        zs.avail_out = static_cast<uInt>(out.size() - used);
+
+        int rc = deflate(&zs, flush);
+        out.resize(out.size() - zs.avail_out);
+        if (rc == Z_STREAM_END) break;
+        if (rc != Z_OK && rc != Z_BUF_ERROR) throw std::runtime_error("deflate failed");
+        if (!last && zs.avail_out != 0) break;
+    }
+
+    record(metrics, start, in.size(), out.size() - before);
+}
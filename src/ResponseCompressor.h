@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Metrics.h"
+
+// I name the HTTP content codings the server can produce. "deflate" is
+// the zlib format (RFC 9110), not raw deflate.
+enum class ContentCoding { identity, gzip, deflate };
+
+// I pick the coding for an Accept-Encoding value: the highest q among
+// gzip and deflate (gzip on a tie, and for "*"), identity otherwise.
+ContentCoding negotiateContentCoding(std::string_view acceptEncoding);
+
+const char* contentCodingName(ContentCoding coding);
+
+// I count what compression costs and saves, for /metrics. Time is wall
+// time inside zlib, which is CPU-bound, so it stands in for CPU time.
+struct CompressionMetrics {
+    LatencyHistogram latency;                   // one sample per zlib call
+    std::atomic<std::uint64_t> responses{0};
+    std::atomic<std::uint64_t> bytesIn{0};
+    std::atomic<std::uint64_t> bytesOut{0};
+};
+
+// I compress a whole body in one call. Each thread keeps one zlib stream
+// per coding and resets it between bodies, so a response never pays for
+// deflateInit's allocations. Returns false (out untouched) on failure.
+bool compressBody(std::string_view in, ContentCoding coding, int level, std::string& out,
+                  CompressionMetrics* metrics = nullptr);
+
+// I compress a body that is produced in chunks. I own my zlib stream
+// because successive chunks may be produced on different threads.
+class StreamCompressor {
+public:
+    StreamCompressor(ContentCoding coding, int level, CompressionMetrics* metrics = nullptr);
+    ~StreamCompressor();
+
+    StreamCompressor(const StreamCompressor&) = delete;
+    StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+    // I append the compressed form of in to out; out may stay empty
+    // until zlib has a full block. last finishes the stream.
+    void write(std::string_view in, bool last, std::string& out);
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+    CompressionMetrics* metrics;
+};
@@ -0,0 +1,161 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/beast/http.hpp>
+
+// I hold the {name} segments captured while matching a route.
+// Values are views into the request target, so nothing is allocated.
+// Only the first `count` entries are set, so making one costs nothing
+// for the literal routes that capture none.
+struct RouteParams {
+    static constexpr std::size_t kMax = 4;
+
+    std::array<std::string_view, kMax> names;
+    std::array<std::string_view, kMax> values;
+    std::size_t count = 0;
+
+    std::string_view get(std::string_view name) const {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (names[i] == name) return values[i];
+        }
+        return {};
+    }
+};
+
+// I resolve method + path to a target from a table built once at startup.
+// Literal paths are bucketed by length, so finding one is a couple of
+// compares against same-length paths, with no hashing; patterns with
+// {name} segments are tried in registration order only when that misses.
+// Patterns must outlive the router (string literals in practice).
+template <class Target>
+class Router {
+public:
+    enum class Match { found, methodNotAllowed, notFound };
+
+    void add(boost::beast::http::verb method, std::string_view pattern, Target target) {
+        if (pattern.find('{') == std::string_view::npos) {
+            if (literals.size() <= pattern.size()) literals.resize(pattern.size() + 1);
+            auto& bucket = literals[pattern.size()];
+            auto it = std::find_if(bucket.begin(), bucket.end(),
+                                   [pattern](const Literal& l) { return l.path == pattern; });
+            if (it == bucket.end()) it = bucket.insert(bucket.end(), Literal{ pattern, {} });
+            it->methods.push_back(Method{ method, target });
+        } else {
+            patterns.push_back(Pattern{ pattern, Method{ method, target } });
+        }
+    }
+
+    Match find(boost::beast::http::verb method, std::string_view path,
+               Target& outTarget, RouteParams& outParams) const {
+        bool pathKnown = false;
+
+        if (path.size() < literals.size()) {
+            for (const auto& literal : literals[path.size()]) {
+                if (literal.path != path) continue;
+                for (const auto& candidate : literal.methods) {
+                    if (candidate.method != method) continue;
+                    outTarget = candidate.target;
+                    outParams.count = 0;
+                    return Match::found;
+                }
+                pathKnown = true;
+                break;
+            }
+        }
+
+        for (const auto& entry : patterns) {
+            RouteParams params;
+            if (!matchPattern(entry.pattern, path, params)) continue;
+
+            pathKnown = true;
+            if (entry.route.method != method) continue;
+
+            outTarget = entry.route.target;
+            outParams = params;
+            return Match::found;
+        }
+        return pathKnown ? Match::methodNotAllowed : Match::notFound;
+    }
+
+private:
+    struct Method {
+        boost::beast::http::verb method;
+        Target target;
+    };
+
+    struct Literal {
+        std::string_view path;
+        std::vector<Method> methods;
+    };
+
+    struct Pattern {
+        std::string_view pattern;
+        Method route;
+    };
+
+    // I walk pattern and path segment by segment, capturing {name} ones.
+    static bool matchPattern(std::string_view pattern, std::string_view path, RouteParams& params) {
+        while (!pattern.empty() && !path.empty()) {
+            auto pEnd = pattern.find('/', 1);
+            auto sEnd = path.find('/', 1);
+            std::string_view pSeg = pattern.substr(0, pEnd);
+            std::string_view sSeg = path.substr(0, sEnd);
+
+            if (pSeg.size() > 2 && pSeg[1] == '{' && pSeg.back() == '}') {
+                if (sSeg.size() < 2 || params.count == RouteParams::kMax) return false;
+                params.names[params.count] = pSeg.substr(2, pSeg.size() - 3);
+                params.values[params.count] = sSeg.substr(1);
+                ++params.count;
+            } else if (pSeg != sSeg) {
+                return false;
+            }
+
+            pattern = pEnd == std::string_view::npos ? std::string_view{} : pattern.substr(pEnd);
+            path = sEnd == std::string_view::npos ? std::string_view{} : path.substr(sEnd);
+        }
+        return pattern.empty() && path.empty();
+    }
+
+    // literals[n] holds the literal paths n characters long.
+    std::vector<std::vector<Literal>> literals;
+    std::vector<Pattern> patterns;
+};
+
+// I serialize a fixed response once per (HTTP version, keep-alive)
+// combination, so serving it is a single write of ready-made bytes.
+class StaticResponse {
+public:
+    StaticResponse() = default;
+
+    template <class Body, class Fields>
+    explicit StaticResponse(const boost::beast::http::response<Body, Fields>& templ)
+        : payload(templ.body()) {
+        for (int v = 0; v < 2; ++v) {
+            for (int k = 0; k < 2; ++k) {
+                auto res = templ;
+                res.version(v ? 11 : 10);
+                res.keep_alive(k != 0);
+                res.prepare_payload();
+
+                std::ostringstream out;
+                out << res;
+                variants[v][k] = out.str();
+            }
+        }
+    }
+
+    std::string_view bytes(unsigned version, bool keepAlive) const {
+        return variants[version >= 11 ? 1 : 0][keepAlive ? 1 : 0];
+    }
+
+    const std::string& body() const { return payload; }
+
+private:
+    std::string payload;
+    std::string variants[2][2];
+};
@@ -0,0 +1,152 @@
+#include "SchemaMigrations.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "CityName.h"
+
+// I never edit a step once it has shipped; a change to the schema is a
+// new step at the end. Every step must also cope with a database that
+// predates versioning (user_version 0) but already has some of the
+// tables, which is why the early ones use IF NOT EXISTS.
+static const Migration kMigrations[] = {
+    { 1, "create users and query_logs",
+        "CREATE TABLE IF NOT EXISTS users ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "username TEXT UNIQUE,"
+        "password TEXT);"
+        "CREATE TABLE IF NOT EXISTS query_logs ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "user_id INTEGER,"
+        "city TEXT,"
+        "summary TEXT,"
+        "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);" },
+
+    // I rebuild both tables with the constraints schema.sql declares.
+    // SQLite cannot add NOT NULL or a foreign key in place. Rows that
+    // would violate NOT NULL were never readable by the app and are dropped.
+    { 2, "add NOT NULL and foreign key constraints",
+        "CREATE TABLE users_new ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "username TEXT NOT NULL UNIQUE,"
+        "password TEXT NOT NULL);"
+        "INSERT INTO users_new (id, username, password) "
+        "SELECT id, username, password FROM users "
+        "WHERE username IS NOT NULL AND password IS NOT NULL;"
+        "DROP TABLE users;"
+        "ALTER TABLE users_new RENAME TO users;"
+        "CREATE TABLE query_logs_new ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "user_id INTEGER NOT NULL,"
+        "city TEXT NOT NULL,"
+        "summary TEXT NOT NULL,"
+        "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+        "FOREIGN KEY (user_id) REFERENCES users(id) ON DELETE CASCADE);"
+        "INSERT INTO query_logs_new (id, user_id, city, summary, timestamp) "
+        "SELECT id, user_id, city, summary, timestamp FROM query_logs "
+        "WHERE user_id IS NOT NULL AND city IS NOT NULL AND summary IS NOT NULL;"
+        "DROP TABLE query_logs;"
+        "ALTER TABLE query_logs_new RENAME TO query_logs;" },
+
+    // I seed query counts from the existing log, unless an earlier build
+    // already kept roll-ups; old rows only have summary text, so they
+    // contribute no readings. lower(trim()) keeps inner and non-space
+    // whitespace, unlike the app's key; step 5 re-keys these rows.
+    { 3, "add hourly per-city roll-ups",
+        "CREATE TABLE IF NOT EXISTS city_hourly ("
+        "city TEXT NOT NULL,"
+        "hour TEXT NOT NULL,"
+        "queries INTEGER NOT NULL,"
+        "readings INTEGER NOT NULL,"
+        "temp_min REAL, temp_max REAL, temp_sum REAL NOT NULL DEFAULT 0,"
+        "wind_min REAL, wind_max REAL, wind_sum REAL NOT NULL DEFAULT 0,"
+        "PRIMARY KEY (city, hour)) WITHOUT ROWID;"
+        "CREATE INDEX IF NOT EXISTS city_hourly_hour ON city_hourly (hour);"
+        "INSERT INTO city_hourly (city, hour, queries, readings) "
+        "SELECT lower(trim(city)), strftime('%Y-%m-%d %H:00:00', timestamp), count(*), 0 "
+        "FROM query_logs WHERE NOT EXISTS (SELECT 1 FROM city_hourly) GROUP BY 1, 2;" },
+
+    // I index history in exactly the order it is read, so a page is an
+    // index range scan with no sort, and retention finds rows by age.
+    { 4, "index query_logs for history pages and retention",
+        "DROP INDEX IF EXISTS idx_query_logs_user_id;"
+        "DROP INDEX IF EXISTS idx_query_logs_user_time;"
+        "CREATE INDEX IF NOT EXISTS idx_query_logs_history "
+        "ON query_logs (user_id, timestamp DESC, id DESC);"
+        "CREATE INDEX IF NOT EXISTS idx_query_logs_timestamp ON query_logs (timestamp);" },
+
+    // I re-key every roll-up with normalize_city(), the app's own key, and
+    // merge rows that now share a city and hour, so cities seeded by
+    // step 3 as "new  york" or "paris\t" join the rows the writer adds.
+    { 5, "re-key city roll-ups with the app's city normalization",
+        "CREATE TABLE city_hourly_new ("
+        "city TEXT NOT NULL,"
+        "hour TEXT NOT NULL,"
+        "queries INTEGER NOT NULL,"
+        "readings INTEGER NOT NULL,"
+        "temp_min REAL, temp_max REAL, temp_sum REAL NOT NULL DEFAULT 0,"
+        "wind_min REAL, wind_max REAL, wind_sum REAL NOT NULL DEFAULT 0,"
+        "PRIMARY KEY (city, hour)) WITHOUT ROWID;"
+        "INSERT INTO city_hourly_new "
+        "SELECT normalize_city(city), hour, sum(queries), sum(readings), "
+        "min(temp_min), max(temp_max), sum(temp_sum), min(wind_min), max(wind_max), sum(wind_sum) "
+        "FROM city_hourly GROUP BY 1, 2;"
+        "DROP TABLE city_hourly;"
+        "ALTER TABLE city_hourly_new RENAME TO city_hourly;"
+        "CREATE INDEX IF NOT EXISTS city_hourly_hour ON city_hourly (hour);" },
+};
+
+static const char* const kUserVersion = "PRAGMA user_version;";
+
+// I let migrations key cities exactly as the app does, rather than
+// approximate normalizeCity() in SQL.
+static void normalizeCitySql(sqlite3_context* ctx, int, sqlite3_value** args) {
+    const unsigned char* text = sqlite3_value_text(args[0]);
+    if (!text) return sqlite3_result_null(ctx);
+
+    std::string key = normalizeCity({ reinterpret_cast<const char*>(text),
+                                      static_cast<std::size_t>(sqlite3_value_bytes(args[0])) });
+    sqlite3_result_text(ctx, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+}
+
+int latestSchemaVersion() {
+    return kMigrations[sizeof(kMigrations) / sizeof(kMigrations[0]) - 1].version;
+}
+
+int applyMigrations(SqliteConnection& conn) {
+    int current = 0;
+    {
+        Statement stmt = conn.statement(kUserVersion);
+        if (stmt && sqlite3_step(stmt.get()) == SQLITE_ROW) current = sqlite3_column_int(stmt.get(), 0);
+    }
+
+    // I refuse to run against a schema I do not know rather than
+    // silently use tables that may have changed shape.
+    if (current > latestSchemaVersion()) {
+        throw std::runtime_error("Database schema version " + std::to_string(current) +
+                                 " is newer than this build supports (" +
+                                 std::to_string(latestSchemaVersion()) + ")");
+    }
+
+    if (sqlite3_create_function(conn.handle(), "normalize_city", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                nullptr, normalizeCitySql, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error(std::string("Cannot register normalize_city: ") +
+                                 sqlite3_errmsg(conn.handle()));
+    }
+
+    for (const auto& step : kMigrations) {
+        if (step.version <= current) continue;
+
+        try {
+            conn.execute(std::string("BEGIN IMMEDIATE;") + step.sql +
+                         "PRAGMA user_version = " + std::to_string(step.version) + ";COMMIT;");
+        }
+        catch (const std::exception& ex) {
+            sqlite3_exec(conn.handle(), "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw std::runtime_error("Migration " + std::to_string(step.version) + " (" +
+                                     step.description + ") failed: " + ex.what());
+        }
+        current = step.version;
+    }
+    return current;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "SqliteConnection.h"
+
+// I describe one numbered schema change. Steps are applied in order and
+// each one runs in its own transaction together with the user_version
+// bump, so a database is always exactly at some step.
+struct Migration {
+    int version;
+    const char* description;
+    const char* sql;
+};
+
+// I bring the database up to the newest step and return that version.
+// Foreign key enforcement must be off while this runs, since some steps
+// rebuild tables. I throw if a step fails (it is rolled back) or if the
+// file was written by a newer build than this one.
+int applyMigrations(SqliteConnection& conn);
+
+// I return the version the newest migration produces.
+int latestSchemaVersion();
@@ -1,39 +1,211 @@
 #include "SessionManager.h"
-#include <random>
-#include <sstream>
+#include <openssl/rand.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool SessionKey::parse(std::string_view hex, SessionKey& out) {
+    if (hex.size() != 32) return false;
+
+    std::uint64_t parts[2] = { 0, 0 };
+    for (std::size_t i = 0; i < 32; ++i) {
+        int d = hexDigit(hex[i]);
+        if (d < 0) return false;
+        parts[i / 16] = (parts[i / 16] << 4) | static_cast<std::uint64_t>(d);
+    }
+    out.hi = parts[0];
+    out.lo = parts[1];
+    return true;
+}
+
+std::string SessionKey::toString() const {
+    static const char* digits = "0123456789abcdef";
+    std::string out(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        out[15 - i] = digits[(hi >> (4 * i)) & 0xF];
+        out[31 - i] = digits[(lo >> (4 * i)) & 0xF];
+    }
+    return out;
+}
+
+SessionManager::SessionManager(const SessionOptions& opts) : options(opts) {
+    if (!options.signingKeys.empty()) {
+        signer = std::make_unique<TokenSigner>(options.signingKeys);
+    }
+}
+
+std::int64_t SessionManager::nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 // I generate opaque session tokens instead of deriving them
 // from user data to avoid leaking information.
-std::string SessionManager::generateToken() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, 15);
+SessionKey SessionManager::generateKey() {
+    // I use OpenSSL's CSPRNG since tokens are bearer credentials.
+    unsigned char bytes[16];
+    if (RAND_bytes(bytes, sizeof(bytes)) != 1) {
+        throw std::runtime_error("Failed to generate session token");
+    }
 
-    // I generate a fixed-length hex string to keep tokens uniform.
-    std::stringstream ss;
-    for (int i = 0; i < 32; ++i) {
-        ss << std::hex << dis(gen);
+    SessionKey key;
+    for (int i = 0; i < 8; ++i) {
+        key.hi = (key.hi << 8) | bytes[i];
+        key.lo = (key.lo << 8) | bytes[8 + i];
     }
-    return ss.str();
+    return key;
+}
+
+bool SessionManager::expired(const Entry& entry, std::int64_t now) const {
+    return now - entry.createdAt >= options.absoluteTtl.count() ||
+           now - entry.lastSeen.load(std::memory_order_relaxed) >= options.idleTtl.count();
 }
 
 std::string SessionManager::createSession(int userId, const std::string& username) {
-    // I lock here to keep session creation thread-safe.
-    std::lock_guard<std::mutex> lock(mutex);
+    if (signer) {
+        return signer->sign(userId, username,
+                            TokenSigner::nowSeconds() + options.absoluteTtl.count());
+    }
+
+    sweepSome();
+
+    SessionKey key = generateKey();
+    std::int64_t now = nowSeconds();
+
+    // I lock the user index first and a shard second, the only order
+    // in which both are ever held together.
+    std::lock_guard<std::mutex> usersLock(usersMutex);
+    {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.sessions.try_emplace(key, Session{ userId, username }, now);
+    }
+
+    auto& tokens = userSessions[userId];
+    tokens.push_back(key);
+    while (tokens.size() > options.maxSessionsPerUser) {
+        SessionKey oldest = tokens.front();
+        tokens.pop_front();
+
+        Shard& shard = shardFor(oldest);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.sessions.erase(oldest);
+    }
 
-    std::string token = generateToken();
-    sessions[token] = { userId, username };
-    return token;
+    return key.toString();
 }
 
-bool SessionManager::validateToken(const std::string& token, Session& outSession) {
-    // I lock here as well since validation reads shared state.
-    std::lock_guard<std::mutex> lock(mutex);
+bool SessionManager::validateToken(std::string_view token, Session& outSession) {
+    if (signer && TokenSigner::looksSigned(token)) {
+        TokenClaims claims;
+        if (!signer->verify(token, claims)) return false;
+        outSession = Session{ claims.userId, std::move(claims.username) };
+        return true;
+    }
+
+    SessionKey key;
+    if (!SessionKey::parse(token, key)) return false;
 
-    auto it = sessions.find(token);
-    if (it == sessions.end())
-        return false;
+    Shard& shard = shardFor(key);
+    std::int64_t now = nowSeconds();
+    int expiredUser = -1;
+    {
+        // I only take the shared lock on the hot path.
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
 
-    outSession = it->second;
+        auto it = shard.sessions.find(key);
+        if (it == shard.sessions.end())
+            return false;
+
+        if (!expired(it->second, now)) {
+            // I skip the store when the second has not changed, so busy
+            // sessions do not bounce the cache line between cores.
+            if (it->second.lastSeen.load(std::memory_order_relaxed) != now) {
+                it->second.lastSeen.store(now, std::memory_order_relaxed);
+            }
+            outSession = it->second.session;
+            return true;
+        }
+        expiredUser = it->second.session.userId;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.sessions.erase(key);
+    }
+    forgetUserSession(expiredUser, key);
+    return false;
+}
+
+bool SessionManager::removeSession(std::string_view token) {
+    if (signer && TokenSigner::looksSigned(token)) {
+        TokenClaims claims;
+        if (!signer->verify(token, claims)) return false;
+        signer->revoke(claims);
+        return true;
+    }
+
+    SessionKey key;
+    if (!SessionKey::parse(token, key)) return false;
+
+    int userId;
+    {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.sessions.find(key);
+        if (it == shard.sessions.end()) return false;
+        userId = it->second.session.userId;
+        shard.sessions.erase(it);
+    }
+    forgetUserSession(userId, key);
     return true;
 }
+
+void SessionManager::forgetUserSession(int userId, const SessionKey& key) {
+    std::lock_guard<std::mutex> lock(usersMutex);
+
+    auto it = userSessions.find(userId);
+    if (it == userSessions.end()) return;
+
+    auto& tokens = it->second;
+    tokens.erase(std::remove(tokens.begin(), tokens.end(), key), tokens.end());
+    if (tokens.empty()) userSessions.erase(it);
+}
+
+void SessionManager::sweepSome() {
+    static constexpr std::size_t kBucketsPerSweep = 64;
+
+    Shard& shard = shards[sweepCursor.fetch_add(1, std::memory_order_relaxed) % kShardCount];
+    std::int64_t now = nowSeconds();
+
+    std::vector<std::pair<int, SessionKey>> removed;
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        std::size_t buckets = shard.sessions.bucket_count();
+        for (std::size_t n = 0; n < kBucketsPerSweep && n < buckets; ++n) {
+            std::size_t bucket = shard.sweepBucket++ % buckets;
+            for (auto it = shard.sessions.begin(bucket); it != shard.sessions.end(bucket); ++it) {
+                if (expired(it->second, now)) removed.emplace_back(it->second.session.userId, it->first);
+            }
+        }
+        for (const auto& entry : removed) shard.sessions.erase(entry.second);
+    }
+
+    for (const auto& entry : removed) forgetUserSession(entry.first, entry.second);
+}
+
+std::size_t SessionManager::activeSessions() const {
+    std::size_t total = 0;
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.sessions.size();
+    }
+    return total;
+}
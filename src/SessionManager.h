@@ -1,7 +1,17 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <deque>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "TokenSigner.h"
 
 // I keep session data minimal and decoupled from persistence.
 struct Session {
@@ -9,22 +19,113 @@ struct Session {
     std::string username;
 };
 
+// I keep session lifetimes configurable so deployments can trade
+// convenience for exposure.
+struct SessionOptions {
+    // I expire a session that has not been used for this long...
+    std::chrono::seconds idleTtl{std::chrono::minutes(30)};
+
+    // ...and any session older than this, however active.
+    std::chrono::seconds absoluteTtl{std::chrono::hours(24)};
+
+    // I evict a user's oldest session once they hold this many. It must
+    // be at least 1, or a login would evict the session it just made.
+    std::size_t maxSessionsPerUser = 10;
+
+    // I switch to stateless HMAC-signed tokens when keys are given
+    // (the first one signs). Such tokens carry their own expiry
+    // (absoluteTtl) and need no shared state, so any instance holding
+    // the keys accepts them; idleTtl and the per-user cap do not apply.
+    std::vector<SigningKey> signingKeys;
+};
+
+// I store tokens as their 128 raw bits instead of 32 hex characters,
+// which halves the key size and makes hashing and comparison trivial.
+struct SessionKey {
+    std::uint64_t hi = 0;
+    std::uint64_t lo = 0;
+
+    bool operator==(const SessionKey& other) const { return hi == other.hi && lo == other.lo; }
+
+    // I accept exactly 32 hex digits and reject anything else.
+    static bool parse(std::string_view hex, SessionKey& out);
+    std::string toString() const;
+};
+
+struct SessionKeyHash {
+    // I can use the bits directly since tokens are uniformly random.
+    std::size_t operator()(const SessionKey& key) const {
+        return static_cast<std::size_t>(key.lo ^ (key.hi >> 7));
+    }
+};
+
 class SessionManager {
 public:
+    explicit SessionManager(const SessionOptions& options = SessionOptions{});
+
     // I create sessions by issuing opaque tokens mapped to user state.
     std::string createSession(int userId, const std::string& username);
 
     // I validate tokens by resolving them into session data.
-    bool validateToken(const std::string& token, Session& outSession);
+    // Expired sessions are removed on the spot.
+    bool validateToken(std::string_view token, Session& outSession);
+
+    // I end a session early (logout). Returns false for unknown tokens.
+    // Signed tokens are added to a revocation list until they expire.
+    bool removeSession(std::string_view token);
+
+    // I count live entries for instrumentation; expired ones that have
+    // not been swept yet are included.
+    std::size_t activeSessions() const;
 
 private:
+    static constexpr std::size_t kShardCount = 16;
+
+    struct Entry {
+        Entry(Session s, std::int64_t now) : session(std::move(s)), createdAt(now), lastSeen(now) {}
+
+        Session session;
+        std::int64_t createdAt;
+
+        // I update this under a shared lock, hence atomic.
+        std::atomic<std::int64_t> lastSeen;
+    };
+
+    // I shard the map so validations on different tokens rarely touch
+    // the same lock, and use reader/writer locks since lookups dominate.
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<SessionKey, Entry, SessionKeyHash> sessions;
+        std::size_t sweepBucket = 0;
+    };
+
     // I centralize token generation so format and entropy stay consistent.
-    std::string generateToken();
+    SessionKey generateKey();
+
+    Shard& shardFor(const SessionKey& key) { return shards[key.lo % kShardCount]; }
+
+    bool expired(const Entry& entry, std::int64_t now) const;
+
+    // I drop expired sessions from a few buckets of one shard per call
+    // (round robin), so cleanup cost is small, bounded and spread
+    // across session creations instead of needing a timer thread.
+    void sweepSome();
+
+    // I erase a token from the per-user index (must not hold a shard lock).
+    void forgetUserSession(int userId, const SessionKey& key);
+
+    static std::int64_t nowSeconds();
+
+    SessionOptions options;
+
+    // I am only set in stateless mode; in-memory tokens keep working
+    // alongside so a switch does not invalidate live sessions.
+    std::unique_ptr<TokenSigner> signer;
 
-    // I store sessions in memory since they are short-lived
-    // and scoped to the server runtime.
-    std::unordered_map<std::string, Session> sessions;
+    Shard shards[kShardCount];
+    std::atomic<std::size_t> sweepCursor{0};
 
-    // I protect session access to allow safe concurrent requests.
-    std::mutex mutex;
+    // I track each user's tokens oldest first to enforce the per-user cap.
+    std::mutex usersMutex;
+    std::unordered_map<int, std::deque<SessionKey>> userSessions;
 };
@@ -0,0 +1,42 @@
+#include "SqliteConnection.h"
+#include <stdexcept>
+
+// I open the database immediately so failure is explicit and fatal.
+SqliteConnection::SqliteConnection(const std::string& filename, int flags) : db(nullptr) {
+    if (sqlite3_open_v2(filename.c_str(), &db, flags, nullptr) != SQLITE_OK) {
+        std::string msg = db ? sqlite3_errmsg(db) : "out of memory";
+        if (db) sqlite3_close(db);
+        throw std::runtime_error("Failed to open database: " + msg);
+    }
+
+    // I wait briefly on a locked database instead of failing immediately,
+    // since readers and the writer now run concurrently.
+    sqlite3_busy_timeout(db, 5000);
+}
+
+// I finalize cached statements before closing, otherwise close fails.
+SqliteConnection::~SqliteConnection() {
+    for (auto& entry : statements) sqlite3_finalize(entry.second);
+    if (db) sqlite3_close(db);
+}
+
+Statement SqliteConnection::statement(const char* sql) {
+    auto it = statements.find(sql);
+    if (it != statements.end()) return Statement(it->second);
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK)
+        return Statement(nullptr);
+
+    statements.emplace(sql, stmt);
+    return Statement(stmt);
+}
+
+void SqliteConnection::execute(const std::string& sql) {
+    char* err = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
+        std::string msg = err ? err : sqlite3_errmsg(db);
+        sqlite3_free(err);
+        throw std::runtime_error(msg);
+    }
+}
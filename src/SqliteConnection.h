@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <sqlite3.h>
+
+class SqliteConnection;
+
+// I return statements through a guard that resets them on scope exit,
+// so a cached statement is always clean for its next user.
+class Statement {
+public:
+    explicit Statement(sqlite3_stmt* stmt) : stmt(stmt) {}
+    ~Statement() {
+        if (stmt) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+    }
+
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+    Statement(Statement&& other) noexcept : stmt(other.stmt) { other.stmt = nullptr; }
+
+    sqlite3_stmt* get() const { return stmt; }
+    explicit operator bool() const { return stmt != nullptr; }
+
+private:
+    sqlite3_stmt* stmt;
+};
+
+// I own one sqlite3 handle plus the statements prepared on it.
+// A connection is used by one thread at a time; Database decides which.
+class SqliteConnection {
+public:
+    // I open with explicit flags so readers can be opened read-only.
+    SqliteConnection(const std::string& filename, int flags);
+    ~SqliteConnection();
+
+    SqliteConnection(const SqliteConnection&) = delete;
+    SqliteConnection& operator=(const SqliteConnection&) = delete;
+
+    // I prepare each SQL text once and hand back the cached statement
+    // afterwards. The key is the pointer, so sql must be a string literal
+    // (or otherwise outlive the connection). Returns an empty guard on error.
+    Statement statement(const char* sql);
+
+    // I centralize raw SQL execution to keep error handling consistent.
+    void execute(const std::string& sql);
+
+    sqlite3* handle() const { return db; }
+
+private:
+    sqlite3* db;
+    std::unordered_map<const char*, sqlite3_stmt*> statements;
+};
@@ -0,0 +1,213 @@
+#include "TokenSigner.h"
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include <chrono>
+#include <stdexcept>
+
+static const char* kBase64Url =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// I use unpadded base64url so tokens are safe in headers and URLs.
+static std::string base64UrlEncode(const unsigned char* data, std::size_t size) {
+    std::string out;
+    out.reserve((size * 4 + 2) / 3);
+    std::size_t i = 0;
+    for (; i + 2 < size; i += 3) {
+        std::uint32_t n = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out += kBase64Url[(n >> 18) & 63];
+        out += kBase64Url[(n >> 12) & 63];
+        out += kBase64Url[(n >> 6) & 63];
+        out += kBase64Url[n & 63];
+    }
+    if (i + 1 == size) {
+        std::uint32_t n = data[i] << 16;
+        out += kBase64Url[(n >> 18) & 63];
+        out += kBase64Url[(n >> 12) & 63];
+    } else if (i + 2 == size) {
+        std::uint32_t n = (data[i] << 16) | (data[i + 1] << 8);
+        out += kBase64Url[(n >> 18) & 63];
+        out += kBase64Url[(n >> 12) & 63];
+        out += kBase64Url[(n >> 6) & 63];
+    }
+    return out;
+}
+
+static bool base64UrlDecode(std::string_view in, std::string& out) {
+    out.clear();
+    std::uint32_t buffer = 0;
+    int bits = 0;
+    for (char c : in) {
+        int v;
+        if (c >= 'A' && c <= 'Z') v = c - 'A';
+        else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') v = c - '0' + 52;
+        else if (c == '-') v = 62;
+        else if (c == '_') v = 63;
+        else return false;
+
+        buffer = (buffer << 6) | static_cast<std::uint32_t>(v);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out += static_cast<char>((buffer >> bits) & 0xFF);
+        }
+    }
+    return true;
+}
+
+static std::string hmacSha256(const std::string& secret, std::string_view message) {
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()),
+         reinterpret_cast<const unsigned char*>(message.data()), message.size(), mac, &length);
+    return base64UrlEncode(mac, length);
+}
+
+// I split off the text before the next separator and advance the view.
+static bool nextField(std::string_view& rest, char separator, std::string_view& field) {
+    auto pos = rest.find(separator);
+    if (pos == std::string_view::npos) return false;
+    field = rest.substr(0, pos);
+    rest.remove_prefix(pos + 1);
+    return true;
+}
+
+static bool parseInt64(std::string_view text, std::int64_t& out) {
+    if (text.empty() || text.size() > 18) return false;
+    std::int64_t value = 0;
+    bool negative = text[0] == '-';
+    if (negative) text.remove_prefix(1);
+    if (text.empty()) return false;
+    for (char c : text) {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + (c - '0');
+    }
+    out = negative ? -value : value;
+    return true;
+}
+
+TokenSigner::TokenSigner(std::vector<SigningKey> signingKeys) : keys(std::move(signingKeys)) {
+    if (keys.empty()) throw std::invalid_argument("TokenSigner needs at least one key");
+}
+
+bool TokenSigner::parseKeys(const std::string& spec, std::vector<SigningKey>& out) {
+    out.clear();
+    std::string_view rest = spec;
+    while (!rest.empty()) {
+        auto comma = rest.find(',');
+        std::string_view item = rest.substr(0, comma);
+        rest = comma == std::string_view::npos ? std::string_view{} : rest.substr(comma + 1);
+
+        auto colon = item.find(':');
+        if (colon == std::string_view::npos || colon == 0 || colon + 1 == item.size()) return false;
+
+        std::string_view id = item.substr(0, colon);
+        if (id.find('.') != std::string_view::npos) return false;
+        out.push_back(SigningKey{ std::string(id), std::string(item.substr(colon + 1)) });
+    }
+    return !out.empty();
+}
+
+bool TokenSigner::looksSigned(std::string_view token) {
+    return token.rfind("v1.", 0) == 0;
+}
+
+std::int64_t TokenSigner::nowSeconds() {
+    // I use wall-clock time since tokens are checked by other processes.
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+const SigningKey* TokenSigner::findKey(std::string_view id) const {
+    for (const auto& key : keys) {
+        if (key.id == id) return &key;
+    }
+    return nullptr;
+}
+
+std::string TokenSigner::sign(int userId, const std::string& username, std::int64_t expiresAt) {
+    unsigned char nonceBytes[12];
+    if (RAND_bytes(nonceBytes, sizeof(nonceBytes)) != 1) {
+        throw std::runtime_error("Failed to generate token nonce");
+    }
+
+    std::string payload = std::to_string(userId) + "|" + std::to_string(expiresAt) + "|" +
+                          base64UrlEncode(nonceBytes, sizeof(nonceBytes)) + "|" + username;
+
+    const SigningKey& key = keys.front();
+    std::string token = "v1." + key.id + "." +
+        base64UrlEncode(reinterpret_cast<const unsigned char*>(payload.data()), payload.size());
+    std::string mac = hmacSha256(key.secret, token);
+    return token + "." + mac;
+}
+
+bool TokenSigner::verify(std::string_view token, TokenClaims& outClaims) {
+    if (!looksSigned(token)) return false;
+
+    auto lastDot = token.rfind('.');
+    if (lastDot == std::string_view::npos) return false;
+    std::string_view signedPart = token.substr(0, lastDot);
+    std::string_view mac = token.substr(lastDot + 1);
+
+    std::string_view rest = signedPart.substr(3);
+    std::string_view keyId;
+    if (!nextField(rest, '.', keyId)) return false;
+    std::string_view encodedPayload = rest;
+
+    const SigningKey* key = findKey(keyId);
+    if (!key) return false;
+
+    // I compare MACs in constant time so timing does not leak them.
+    std::string expected = hmacSha256(key->secret, signedPart);
+    if (expected.size() != mac.size() ||
+        CRYPTO_memcmp(expected.data(), mac.data(), mac.size()) != 0) {
+        return false;
+    }
+
+    std::string payload;
+    if (!base64UrlDecode(encodedPayload, payload)) return false;
+
+    std::string_view fields = payload;
+    std::string_view userId, expiresAt, nonce;
+    if (!nextField(fields, '|', userId) || !nextField(fields, '|', expiresAt) ||
+        !nextField(fields, '|', nonce)) {
+        return false;
+    }
+
+    std::int64_t uid = 0, exp = 0;
+    if (!parseInt64(userId, uid) || !parseInt64(expiresAt, exp)) return false;
+    if (nowSeconds() >= exp) return false;
+
+    std::string nonceText(nonce);
+    if (isRevoked(nonceText)) return false;
+
+    outClaims.userId = static_cast<int>(uid);
+    outClaims.username.assign(fields.data(), fields.size());
+    outClaims.expiresAt = exp;
+    outClaims.nonce = std::move(nonceText);
+    return true;
+}
+
+bool TokenSigner::isRevoked(const std::string& nonce) {
+    // I skip the lock entirely in the common case of no logouts.
+    if (!anyRevoked.load(std::memory_order_acquire)) return false;
+
+    std::shared_lock<std::shared_mutex> lock(revokedMutex);
+    return revoked.count(nonce) != 0;
+}
+
+void TokenSigner::revoke(const TokenClaims& claims) {
+    std::int64_t now = nowSeconds();
+
+    std::unique_lock<std::shared_mutex> lock(revokedMutex);
+    for (auto it = revoked.begin(); it != revoked.end();) {
+        if (it->second <= now) it = revoked.erase(it);
+        else ++it;
+    }
+    revoked[claims.nonce] = claims.expiresAt;
+    anyRevoked.store(true, std::memory_order_release);
+}
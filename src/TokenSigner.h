@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// I name each secret so tokens can say which one signed them,
+// which lets keys be rotated without logging everyone out.
+struct SigningKey {
+    std::string id;
+    std::string secret;
+};
+
+// I carry what a verified token asserts.
+struct TokenClaims {
+    int userId = 0;
+    std::string username;
+    std::int64_t expiresAt = 0;   // unix seconds
+    std::string nonce;            // unique per token, used for revocation
+};
+
+// I issue and verify self-contained session tokens signed with
+// HMAC-SHA256, so any server instance sharing the keys can validate
+// them without shared session state.
+//
+// Format: v1.<key id>.<base64url payload>.<base64url signature>
+// where the payload is "<userId>|<expiresAt>|<nonce>|<username>".
+class TokenSigner {
+public:
+    // I sign with the first key and accept any of them when verifying.
+    // Throws std::invalid_argument when keys is empty.
+    explicit TokenSigner(std::vector<SigningKey> keys);
+
+    // I parse "id1:secret1,id2:secret2" (the signing key first).
+    static bool parseKeys(const std::string& spec, std::vector<SigningKey>& out);
+
+    // I recognise tokens of this format by their prefix.
+    static bool looksSigned(std::string_view token);
+
+    std::string sign(int userId, const std::string& username, std::int64_t expiresAt);
+
+    // I check the signature in constant time, then expiry and revocation.
+    bool verify(std::string_view token, TokenClaims& outClaims);
+
+    // I reject this token until it would have expired anyway.
+    void revoke(const TokenClaims& claims);
+
+    static std::int64_t nowSeconds();
+
+private:
+    const SigningKey* findKey(std::string_view id) const;
+    bool isRevoked(const std::string& nonce);
+
+    std::vector<SigningKey> keys;
+
+    // I keep revoked nonces only until their tokens expire, so the
+    // list stays as small as the number of recent logouts.
+    std::shared_mutex revokedMutex;
+    std::unordered_map<std::string, std::int64_t> revoked;
+    std::atomic<bool> anyRevoked{false};
+};
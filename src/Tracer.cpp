@@ -0,0 +1,126 @@
+#include "Tracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include "JsonWriter.h"
+
+static thread_local std::uint64_t tlsCurrentTrace = 0;
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::configure(const TracerOptions& options) {
+    spansPerThread.store(std::max<std::size_t>(1, options.spansPerThread), std::memory_order_relaxed);
+    sampleEvery.store(options.sampleEvery, std::memory_order_relaxed);
+}
+
+std::int64_t Tracer::nowNanos() {
+    static const auto origin = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - origin).count();
+}
+
+std::uint64_t Tracer::currentTrace() {
+    return tlsCurrentTrace;
+}
+
+std::uint64_t Tracer::sampleRequest(bool forced) {
+    unsigned every = sampleEvery.load(std::memory_order_relaxed);
+    if (!forced) {
+        if (every == 0) return 0;
+
+        // I count per thread so deciding never touches shared memory.
+        thread_local unsigned counter = 0;
+        if (++counter < every) return 0;
+        counter = 0;
+    }
+    return nextTraceId.fetch_add(1, std::memory_order_relaxed);
+}
+
+Tracer::ThreadBuffer& Tracer::bufferForThisThread() {
+    // I share ownership with the tracer so spans survive thread exit.
+    thread_local std::shared_ptr<ThreadBuffer> mine;
+    if (!mine) {
+        mine = std::make_shared<ThreadBuffer>();
+        mine->capacity = spansPerThread.load(std::memory_order_relaxed);
+        mine->spans.reserve(mine->capacity);
+
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        mine->threadIndex = static_cast<std::uint32_t>(buffers.size() + 1);
+        buffers.push_back(mine);
+    }
+    return *mine;
+}
+
+void Tracer::record(std::uint64_t traceId, const char* name, std::int64_t startNanos, std::int64_t endNanos) {
+    ThreadBuffer& buffer = bufferForThisThread();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+
+    Span span{ name, traceId, startNanos, endNanos };
+    if (buffer.spans.size() < buffer.capacity) {
+        buffer.spans.push_back(span);
+    } else {
+        buffer.spans[buffer.next] = span;
+    }
+    buffer.next = (buffer.next + 1) % buffer.capacity;
+}
+
+std::string Tracer::chromeTraceJson() const {
+    std::vector<std::shared_ptr<ThreadBuffer>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        snapshot = buffers;
+    }
+
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    char numbers[128];
+    for (const auto& buffer : snapshot) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+
+        // I name each thread so the viewer shows "thread N" lanes.
+        if (!first) out.push_back(',');
+        first = false;
+        std::snprintf(numbers, sizeof(numbers),
+                      "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                      "\"args\":{\"name\":\"thread %u\"}}",
+                      buffer->threadIndex, buffer->threadIndex);
+        out += numbers;
+
+        for (const auto& span : buffer->spans) {
+            out += ",{\"name\":";
+            json_writer::appendString(out, span.name);
+            std::snprintf(numbers, sizeof(numbers),
+                          ",\"cat\":\"request\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,",
+                          span.startNanos / 1000.0, (span.endNanos - span.startNanos) / 1000.0,
+                          buffer->threadIndex);
+            out += numbers;
+            out += "\"args\":{\"trace\":";
+            json_writer::appendNumber(out, static_cast<long long>(span.traceId));
+            out += "}}";
+        }
+    }
+    out += "],\"displayTimeUnit\":\"ms\"}";
+    return out;
+}
+
+bool Tracer::writeChromeTrace(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::string json = chromeTraceJson();
+    file.write(json.data(), static_cast<std::streamsize>(json.size()));
+    return static_cast<bool>(file);
+}
+
+TraceContext::TraceContext(std::uint64_t traceId) : previous(tlsCurrentTrace) {
+    tlsCurrentTrace = traceId;
+}
+
+TraceContext::~TraceContext() {
+    tlsCurrentTrace = previous;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// I keep tracing tunables together so main can fill them from flags.
+struct TracerOptions {
+    // I trace one request in this many; zero turns sampling off
+    // (requests can still ask for a trace with an X-Trace header).
+    unsigned sampleEvery = 0;
+
+    // I keep the most recent spans per thread, overwriting the oldest.
+    std::size_t spansPerThread = 4096;
+};
+
+// I record timestamped spans of sampled requests into per-thread ring
+// buffers and export them as Chrome trace_event JSON (chrome://tracing,
+// Perfetto). Spans are attributed to a trace through a thread-local id,
+// so code deep in the stack (DNS, TLS) can add spans without being
+// handed a context, and does nothing but test that id when the current
+// request is not sampled.
+class Tracer {
+public:
+    static Tracer& instance();
+
+    void configure(const TracerOptions& options);
+
+    // I return a fresh trace id if this request should be traced, else 0.
+    std::uint64_t sampleRequest(bool forced);
+
+    // I report whether periodic sampling is on, so callers can skip
+    // taking timestamps they would only need for a sampled request.
+    bool enabled() const { return sampleEvery.load(std::memory_order_relaxed) != 0; }
+
+    // I store one finished span. name must have static storage duration
+    // (or outlive the tracer).
+    void record(std::uint64_t traceId, const char* name, std::int64_t startNanos, std::int64_t endNanos);
+
+    // I render every buffered span as {"traceEvents": [...]}.
+    std::string chromeTraceJson() const;
+
+    // I write chromeTraceJson() to a file; returns false on I/O errors.
+    bool writeChromeTrace(const std::string& path) const;
+
+    // I measure on the steady clock, relative to process start.
+    static std::int64_t nowNanos();
+
+    // I return the trace the calling thread is working on, or 0.
+    static std::uint64_t currentTrace();
+
+private:
+    friend class TraceContext;
+
+    struct Span {
+        const char* name;
+        std::uint64_t traceId;
+        std::int64_t startNanos;
+        std::int64_t endNanos;
+    };
+
+    // I am written by one thread and read by exporters, hence the lock;
+    // it is uncontended except while a dump is running.
+    struct ThreadBuffer {
+        std::mutex mutex;
+        std::vector<Span> spans;
+        std::size_t capacity = 0;
+        std::size_t next = 0;
+        std::uint32_t threadIndex = 0;
+    };
+
+    Tracer() = default;
+
+    ThreadBuffer& bufferForThisThread();
+
+    std::atomic<unsigned> sampleEvery{0};
+    std::atomic<std::size_t> spansPerThread{4096};
+    std::atomic<std::uint64_t> nextTraceId{1};
+
+    mutable std::mutex buffersMutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+// I make a trace current on this thread for my lifetime (0 = none).
+class TraceContext {
+public:
+    explicit TraceContext(std::uint64_t traceId);
+    ~TraceContext();
+
+    TraceContext(const TraceContext&) = delete;
+    TraceContext& operator=(const TraceContext&) = delete;
+
+private:
+    std::uint64_t previous;
+};
+
+// I record my lifetime as a span of the current trace, if there is one.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* spanName)
+        : name(spanName), traceId(Tracer::currentTrace()),
+          start(traceId ? Tracer::nowNanos() : 0) {}
+
+    ~TraceSpan() {
+        if (traceId) Tracer::instance().record(traceId, name, start, Tracer::nowNanos());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    std::uint64_t traceId;
+    std::int64_t start;
+};
@@ -0,0 +1,280 @@
+#include "UpstreamClient.h"
+#include "Tracer.h"
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/version.hpp>
+
+#include <cstdlib>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+using tcp = boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+// I hold exactly one of the two stream flavours depending on the scheme.
+// Each connection has its own io_context: whoever holds the connection
+// runs its asynchronous I/O on the calling thread, bounded by a deadline,
+// without ever running anyone else's handlers.
+struct UpstreamClient::Connection {
+    net::io_context ioc{1};
+    std::optional<net::ssl::stream<tcp::socket>> tls;
+    std::optional<tcp::socket> plain;
+    beast::flat_buffer buffer;
+    Clock::time_point lastUsed;
+
+    tcp::socket& socket() { return tls ? tls->next_layer() : *plain; }
+};
+
+UpstreamOptions UpstreamOptions::fromUrl(const std::string& url) {
+    UpstreamOptions out;
+
+    auto sep = url.find("://");
+    if (sep == std::string::npos) throw std::invalid_argument("upstream URL needs a scheme: " + url);
+
+    out.scheme = url.substr(0, sep);
+    if (out.scheme != "http" && out.scheme != "https")
+        throw std::invalid_argument("unsupported upstream scheme: " + out.scheme);
+
+    std::string authority = url.substr(sep + 3);
+    auto slash = authority.find('/');
+    if (slash != std::string::npos) authority.resize(slash);
+
+    auto colon = authority.rfind(':');
+    if (colon != std::string::npos) {
+        out.host = authority.substr(0, colon);
+        out.port = authority.substr(colon + 1);
+    } else {
+        out.host = authority;
+        out.port = out.scheme == "https" ? "443" : "80";
+    }
+
+    if (out.host.empty()) throw std::invalid_argument("upstream URL has no host: " + url);
+    return out;
+}
+
+UpstreamOptions UpstreamOptions::fromEnvironment() {
+    const char* url = std::getenv("WEATHERAPI_URL");
+    return url ? fromUrl(url) : UpstreamOptions{};
+}
+
+// I turn a timeout into a deadline; zero means none.
+static Clock::time_point deadlineAfter(std::chrono::milliseconds timeout) {
+    return timeout.count() > 0 ? Clock::now() + timeout : Clock::time_point::max();
+}
+
+// I run ioc on this thread until done is set or the deadline passes,
+// and report whether it was done in time.
+static bool runUntil(net::io_context& ioc, const bool& done, Clock::time_point deadline) {
+    ioc.restart();
+    if (deadline == Clock::time_point::max()) {
+        while (!done && ioc.run_one() > 0) {}
+    } else {
+        while (!done && ioc.run_one_until(deadline) > 0) {}
+    }
+    return done;
+}
+
+// I wait for the operation start() begins on socket's io_context. On a
+// missed deadline I close the socket, let the aborted operation finish
+// (its handler refers to this frame) and throw UpstreamTimeout.
+template <class Start>
+static void await(net::io_context& ioc, tcp::socket& socket, Clock::time_point deadline,
+                  const char* phase, Start start) {
+    bool done = false;
+    boost::system::error_code result;
+    start([&done, &result](boost::system::error_code ec, auto&&...) {
+        result = ec;
+        done = true;
+    });
+
+    if (!runUntil(ioc, done, deadline)) {
+        boost::system::error_code ignored;
+        socket.close(ignored);
+        runUntil(ioc, done, Clock::time_point::max());
+        throw UpstreamTimeout(std::string("upstream ") + phase + " timed out");
+    }
+    if (result) throw boost::system::system_error(result);
+}
+
+UpstreamClient::UpstreamClient(const UpstreamOptions& opts)
+    : options(opts), useTls(opts.scheme == "https"),
+      ssl(net::ssl::context::tls_client), resolver(ioc) {
+    // I rely on system trust stores to validate HTTPS certificates.
+    ssl.set_default_verify_paths();
+
+    // I let OpenSSL keep client-side sessions so they can be resumed.
+    SSL_CTX_set_session_cache_mode(ssl.native_handle(), SSL_SESS_CACHE_CLIENT);
+}
+
+UpstreamClient::~UpstreamClient() {
+    if (tlsSession) SSL_SESSION_free(tlsSession);
+}
+
+tcp::resolver::results_type UpstreamClient::resolve() {
+    std::lock_guard<std::mutex> lock(dnsMutex);
+
+    if (addresses.empty() || Clock::now() >= addressesExpire) {
+        TraceSpan span("upstream dns");
+
+        // I keep the result in shared state: a lookup that timed out
+        // still completes later (getaddrinfo cannot be interrupted) and
+        // its handler runs during some later resolve.
+        struct Lookup {
+            bool done = false;
+            boost::system::error_code ec;
+            tcp::resolver::results_type results;
+        };
+        auto lookup = std::make_shared<Lookup>();
+        resolver.async_resolve(options.host, options.port,
+                               [lookup](boost::system::error_code ec, tcp::resolver::results_type results) {
+                                   lookup->ec = ec;
+                                   lookup->results = std::move(results);
+                                   lookup->done = true;
+                               });
+        if (!runUntil(ioc, lookup->done, deadlineAfter(options.resolveTimeout))) {
+            resolver.cancel();
+            throw UpstreamTimeout("upstream resolve timed out");
+        }
+        if (lookup->ec) throw boost::system::system_error(lookup->ec);
+
+        addresses = std::move(lookup->results);
+        addressesExpire = Clock::now() + options.dnsTtl;
+    }
+    return addresses;
+}
+
+void UpstreamClient::forgetAddresses() {
+    std::lock_guard<std::mutex> lock(dnsMutex);
+    addresses = {};
+}
+
+std::unique_ptr<UpstreamClient::Connection> UpstreamClient::connect() {
+    auto conn = std::make_unique<Connection>();
+    auto endpoints = resolve();
+
+    if (!useTls) {
+        conn->plain.emplace(conn->ioc);
+    } else {
+        conn->tls.emplace(conn->ioc, ssl);
+
+        // I send SNI since most HTTPS front ends route on it.
+        SSL_set_tlsext_host_name(conn->tls->native_handle(), options.host.c_str());
+
+        std::lock_guard<std::mutex> lock(sessionMutex);
+        if (tlsSession) SSL_set_session(conn->tls->native_handle(), tlsSession);
+    }
+
+    try {
+        TraceSpan span("upstream connect");
+        await(conn->ioc, conn->socket(), deadlineAfter(options.connectTimeout), "connect",
+              [&](auto handler) { net::async_connect(conn->socket(), endpoints, std::move(handler)); });
+    }
+    catch (...) {
+        // I re-resolve next time in case the addresses moved.
+        forgetAddresses();
+        throw;
+    }
+
+    conn->socket().set_option(tcp::no_delay(true));
+
+    if (conn->tls) {
+        // I explicitly perform the TLS handshake before sending the request.
+        TraceSpan span("upstream tls handshake");
+        await(conn->ioc, conn->socket(), deadlineAfter(options.handshakeTimeout), "handshake",
+              [&](auto handler) { conn->tls->async_handshake(net::ssl::stream_base::client, std::move(handler)); });
+    }
+    return conn;
+}
+
+std::unique_ptr<UpstreamClient::Connection> UpstreamClient::acquire(bool& reused) {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        while (!idle.empty()) {
+            auto conn = std::move(idle.back());
+            idle.pop_back();
+            if (Clock::now() - conn->lastUsed < options.idleTimeout) {
+                reused = true;
+                return conn;
+            }
+        }
+    }
+    reused = false;
+    return connect();
+}
+
+void UpstreamClient::release(std::unique_ptr<Connection> conn) {
+    conn->lastUsed = Clock::now();
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (idle.size() < options.maxIdleConnections) {
+        idle.push_back(std::move(conn));
+    }
+}
+
+UpstreamClient::Response UpstreamClient::exchange(Connection& conn, const std::string& target) {
+    http::request<http::empty_body> req{http::verb::get, target, 11};
+    req.set(http::field::host, options.host);
+    req.set(http::field::user_agent, "WeatherApp");
+    req.keep_alive(true);
+
+    // I hold the write and the read to one deadline.
+    Response res;
+    auto deadline = deadlineAfter(options.responseTimeout);
+    if (conn.tls) {
+        {
+            TraceSpan span("upstream write");
+            await(conn.ioc, conn.socket(), deadline, "write",
+                  [&](auto handler) { http::async_write(*conn.tls, req, std::move(handler)); });
+        }
+        {
+            TraceSpan span("upstream read");
+            await(conn.ioc, conn.socket(), deadline, "read",
+                  [&](auto handler) { http::async_read(*conn.tls, conn.buffer, res, std::move(handler)); });
+        }
+
+        // I grab the session after the first read because TLS 1.3
+        // delivers resumable tickets only after the handshake completes.
+        if (SSL_SESSION* session = SSL_get1_session(conn.tls->native_handle())) {
+            std::lock_guard<std::mutex> lock(sessionMutex);
+            if (tlsSession) SSL_SESSION_free(tlsSession);
+            tlsSession = session;
+        }
+    } else {
+        {
+            TraceSpan span("upstream write");
+            await(conn.ioc, conn.socket(), deadline, "write",
+                  [&](auto handler) { http::async_write(*conn.plain, req, std::move(handler)); });
+        }
+        {
+            TraceSpan span("upstream read");
+            await(conn.ioc, conn.socket(), deadline, "read",
+                  [&](auto handler) { http::async_read(*conn.plain, conn.buffer, res, std::move(handler)); });
+        }
+    }
+    return res;
+}
+
+UpstreamClient::Response UpstreamClient::get(const std::string& target) {
+    bool reused = false;
+    auto conn = acquire(reused);
+
+    Response res;
+    try {
+        res = exchange(*conn, target);
+    }
+    catch (const boost::system::system_error&) {
+        // I retry once on a fresh connection when a pooled one turns out
+        // to have been closed by the upstream while it sat idle. A timeout
+        // is not retried: the upstream is slow, not gone.
+        if (!reused) throw;
+        conn = connect();
+        res = exchange(*conn, target);
+    }
+
+    if (res.keep_alive()) release(std::move(conn));
+    return res;
+}
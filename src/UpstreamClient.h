@@ -0,0 +1,108 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/http.hpp>
+
+// I describe where the upstream lives so it can be pointed at a local
+// plain-HTTP stub without touching code.
+struct UpstreamOptions {
+    std::string scheme = "https";
+    std::string host = "api.weatherapi.com";
+    std::string port = "443";
+
+    // I keep at most this many idle keep-alive connections around.
+    std::size_t maxIdleConnections = 16;
+
+    // I drop pooled connections idle for longer than this, since the
+    // upstream is likely to have closed them on its side anyway.
+    std::chrono::seconds idleTimeout{30};
+
+    // I re-resolve the host at most this often.
+    std::chrono::seconds dnsTtl{60};
+
+    // I give up on each phase of a call after this long, so a stalled
+    // upstream costs a bounded wait instead of a blocked thread. The
+    // response deadline runs from sending the request to its last byte.
+    // Zero waits for ever.
+    std::chrono::milliseconds resolveTimeout{2000};
+    std::chrono::milliseconds connectTimeout{2000};
+    std::chrono::milliseconds handshakeTimeout{3000};
+    std::chrono::milliseconds responseTimeout{5000};
+
+    // I parse "scheme://host[:port]" and fill in the default port.
+    // Throws std::invalid_argument on anything else.
+    static UpstreamOptions fromUrl(const std::string& url);
+
+    // I read WEATHERAPI_URL, or return the defaults when it is unset.
+    static UpstreamOptions fromEnvironment();
+};
+
+// I am thrown when a phase of an upstream call misses its deadline.
+// what() names the phase, e.g. "upstream connect timed out".
+class UpstreamTimeout : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// I own one long-lived TLS context and a pool of persistent connections
+// so repeated requests skip DNS, TCP connect and the full TLS handshake.
+// All methods are safe to call from several threads at once.
+class UpstreamClient {
+public:
+    using Response = boost::beast::http::response<boost::beast::http::string_body>;
+
+    explicit UpstreamClient(const UpstreamOptions& options = UpstreamOptions{});
+    ~UpstreamClient();
+
+    UpstreamClient(const UpstreamClient&) = delete;
+    UpstreamClient& operator=(const UpstreamClient&) = delete;
+
+    // I perform a GET on a pooled connection and return the full response.
+    // Transport failures are reported by throwing, missed deadlines as
+    // UpstreamTimeout.
+    Response get(const std::string& target);
+
+    const UpstreamOptions& config() const { return options; }
+
+private:
+    struct Connection;
+    using Clock = std::chrono::steady_clock;
+
+    // I hand out an idle connection if one is usable, otherwise dial a new one.
+    std::unique_ptr<Connection> acquire(bool& reused);
+    void release(std::unique_ptr<Connection> conn);
+    std::unique_ptr<Connection> connect();
+
+    boost::asio::ip::tcp::resolver::results_type resolve();
+    void forgetAddresses();
+
+    Response exchange(Connection& conn, const std::string& target);
+
+    UpstreamOptions options;
+    bool useTls;
+
+    // I run the resolver on this io_context, on whichever thread holds
+    // dnsMutex; connections carry their own (see Connection).
+    boost::asio::io_context ioc;
+    boost::asio::ssl::context ssl;
+
+    std::mutex poolMutex;
+    std::vector<std::unique_ptr<Connection>> idle;
+
+    std::mutex dnsMutex;
+    boost::asio::ip::tcp::resolver resolver;
+    boost::asio::ip::tcp::resolver::results_type addresses;
+    Clock::time_point addressesExpire;
+
+    // I keep the most recent TLS session so new connections can resume it
+    // (abbreviated handshake) instead of negotiating from scratch.
+    std::mutex sessionMutex;
+    SSL_SESSION* tlsSession = nullptr;
+};
@@ -0,0 +1,172 @@
+#include "WeatherCache.h"
+
+#include "CityName.h"
+
+#include <optional>
+
+WeatherCache::WeatherCache(WeatherClient& weatherClient, const WeatherCacheOptions& opts)
+    : client(weatherClient), options(opts) {}
+
+std::string WeatherCache::getWeather(const std::string& city) {
+    ObservationPtr observation;
+    std::string error;
+    if (!getObservation(city, observation, error)) return error;
+    return observation->summary();
+}
+
+bool WeatherCache::getObservation(const std::string& city, ObservationPtr& out, std::string& outError,
+                                  bool* overloaded) {
+    std::string key = normalizeCity(city);
+    // I only make the promise (and its shared state) when I lead a fetch.
+    std::optional<std::promise<Fetched>> promise;
+    Fetched result;
+    ObservationPtr stale;
+    bool leader = false;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            if (Clock::now() < it->second.expires) {
+                // I move the entry to the front so it survives eviction longest.
+                lru.splice(lru.begin(), lru, it->second.lruPos);
+                hits.fetch_add(1, std::memory_order_relaxed);
+                out = it->second.observation;
+                return true;
+            }
+            // I keep an expired entry as a fallback while it is recent
+            // enough, and drop older ones so they free their slot.
+            if (Clock::now() < it->second.expires + options.maxStale) {
+                stale = it->second.observation;
+            } else {
+                lru.erase(it->second.lruPos);
+                entries.erase(it);
+            }
+        }
+
+        // I piggyback on a fetch that is already running for this city.
+        auto flight = inflight.find(key);
+        if (flight != inflight.end()) {
+            auto shared = flight->second;
+            lock.unlock();
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+            result = shared.get();
+        } else {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            promise.emplace();
+            inflight.emplace(key, promise->get_future().share());
+            leader = true;
+        }
+    }
+
+    if (leader) result = fetch(key, city, *promise, std::move(stale));
+
+    out = std::move(result.observation);
+    outError = std::move(result.error);
+    if (overloaded) *overloaded = result.overloaded;
+    return out != nullptr;
+}
+
+WeatherCache::Fetched WeatherCache::fetch(const std::string& key, const std::string& city,
+                                          std::promise<Fetched>& promise, ObservationPtr stale) {
+    Fetched result;
+
+    // I shed the fetch rather than wait for a slot: waiting would only
+    // queue this request (and its coalesced waiters) behind the others.
+    std::size_t limit = options.maxConcurrentFetches;
+    bool admitted = limit == 0 || fetching.fetch_add(1, std::memory_order_acq_rel) < limit;
+    if (!admitted) {
+        fetching.fetch_sub(1, std::memory_order_acq_rel);
+        shed.fetch_add(1, std::memory_order_relaxed);
+        if (stale) {
+            staleServed.fetch_add(1, std::memory_order_relaxed);
+            result.observation = std::move(stale);
+            result.fallback = true;
+        } else {
+            result.error = "Weather service is busy, please retry shortly.";
+            result.overloaded = true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inflight.erase(key);
+        }
+        promise.set_value(result);
+        return result;
+    }
+
+    try {
+        auto observation = std::make_shared<WeatherObservation>();
+        bool unavailable = false;
+        bool ok = client.tryGetWeather(city, *observation, result.error, &unavailable);
+        if (limit > 0) fetching.fetch_sub(1, std::memory_order_acq_rel);
+        if (ok) {
+            result.observation = std::move(observation);
+        } else if (unavailable && stale) {
+            // I answer with the last reading rather than an error; its
+            // observedAt tells the client how old it is.
+            staleServed.fetch_add(1, std::memory_order_relaxed);
+            result.observation = std::move(stale);
+            result.error.clear();
+            result.fallback = true;
+        }
+    }
+    catch (...) {
+        if (limit > 0) fetching.fetch_sub(1, std::memory_order_acq_rel);
+
+        // I release waiters even if the client throws unexpectedly.
+        std::lock_guard<std::mutex> lock(mutex);
+        inflight.erase(key);
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inflight.erase(key);
+        // I never cache failures so a transient upstream error is retried,
+        // and leave a stale fallback as it was.
+        if (result.observation && !result.fallback) store(key, result.observation);
+    }
+
+    promise.set_value(result);
+    return result;
+}
+
+void WeatherCache::store(const std::string& key, ObservationPtr observation) {
+    if (options.capacity == 0) return;
+
+    // I replace an expired entry kept as a fallback.
+    auto existing = entries.find(key);
+    if (existing != entries.end()) {
+        lru.erase(existing->second.lruPos);
+        entries.erase(existing);
+    }
+
+    while (entries.size() >= options.capacity) {
+        entries.erase(lru.back());
+        lru.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    lru.push_front(key);
+    entries[key] = Entry{ std::move(observation), Clock::now() + options.ttl, lru.begin() };
+}
+
+WeatherCacheStats WeatherCache::stats() const {
+    std::size_t size;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size = entries.size();
+    }
+    return WeatherCacheStats{
+        hits.load(std::memory_order_relaxed),
+        misses.load(std::memory_order_relaxed),
+        coalesced.load(std::memory_order_relaxed),
+        evictions.load(std::memory_order_relaxed),
+        shed.load(std::memory_order_relaxed),
+        staleServed.load(std::memory_order_relaxed),
+        size,
+        fetching.load(std::memory_order_relaxed)
+    };
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "WeatherClient.h"
+
+// I keep cache tunables together so main can fill them from flags.
+struct WeatherCacheOptions {
+    // I treat a cached observation as fresh for this long.
+    std::chrono::seconds ttl{300};
+
+    // I bound memory by keeping at most this many cities (LRU eviction).
+    std::size_t capacity = 1024;
+
+    // I let at most this many upstream fetches run at once; a miss beyond
+    // that fails straight away as overloaded instead of queueing for the
+    // upstream quota. Zero means no limit.
+    std::size_t maxConcurrentFetches = 32;
+
+    // I keep an expired observation this long past its TTL and serve it
+    // when a refresh fails because upstream is unavailable or the fetch
+    // was shed. Zero drops expired entries at once.
+    std::chrono::seconds maxStale{3600};
+};
+
+// I expose plain counters so callers can report cache effectiveness.
+struct WeatherCacheStats {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t coalesced;
+    std::uint64_t evictions;
+    std::uint64_t shed;
+    std::uint64_t staleServed;
+    std::size_t size;
+    std::size_t fetching;
+};
+
+// I sit in front of WeatherClient so repeated lookups for the same city
+// are answered in-process instead of spending upstream quota.
+// Concurrent misses for one city share a single upstream fetch.
+class WeatherCache {
+public:
+    explicit WeatherCache(WeatherClient& client,
+                          const WeatherCacheOptions& options = WeatherCacheOptions{});
+
+    // I hand out the shared, immutable observation for a city and only
+    // go upstream when it is missing or stale, so a hit copies nothing.
+    // On failure out is reset and outError holds displayable text;
+    // overloaded, when given, tells whether it failed because too many
+    // fetches were already running.
+    bool getObservation(const std::string& city, std::shared_ptr<const WeatherObservation>& out,
+                        std::string& outError, bool* overloaded = nullptr);
+
+    // I return the same text WeatherClient::getWeather would.
+    std::string getWeather(const std::string& city);
+
+    WeatherCacheStats stats() const;
+
+    // I expose the client behind me so its metrics can be reported.
+    const WeatherClient& upstreamClient() const { return client; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    using ObservationPtr = std::shared_ptr<const WeatherObservation>;
+
+    struct Entry {
+        ObservationPtr observation;
+        Clock::time_point expires;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    // I am what a fetch publishes to everyone waiting on it.
+    struct Fetched {
+        ObservationPtr observation;   // null on failure
+        std::string error;
+        bool overloaded = false;
+        bool fallback = false;      // observation is an expired entry
+    };
+
+    // I fetch upstream and publish the result to every waiter.
+    Fetched fetch(const std::string& key, const std::string& city, std::promise<Fetched>& promise,
+                  ObservationPtr stale);
+
+    // I must be called with the mutex held.
+    void store(const std::string& key, ObservationPtr observation);
+
+    WeatherClient& client;
+    WeatherCacheOptions options;
+
+    // I guard the map, the LRU list and the in-flight table together
+    // since every lookup touches all three.
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru;   // front is most recently used
+    std::unordered_map<std::string, std::shared_future<Fetched>> inflight;
+
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+    std::atomic<std::uint64_t> coalesced{0};
+    std::atomic<std::uint64_t> evictions{0};
+    std::atomic<std::uint64_t> shed{0};
+    std::atomic<std::uint64_t> staleServed{0};
+
+    // I count running fetches without a lock; a fetch that takes the
+    // count over the limit gives its slot back and fails.
+    std::atomic<std::size_t> fetching{0};
+};
@@ -1,91 +1,209 @@
 #include "WeatherClient.h"
+#include "Tracer.h"
 
-#include <boost/beast/core.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/beast/http.hpp>
-#include <boost/beast/version.hpp>
-#include <boost/asio.hpp>
-#include <boost/asio/ssl.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <condition_variable>
 #include <cstdlib>
-#include <sstream>
+#include <mutex>
 #include <stdexcept>
 
-using tcp = boost::asio::ip::tcp;
 namespace http = boost::beast::http;
 
-// I use a minimal string-based extractor because I only need
-// a few top-level values and want to avoid a full JSON dependency here.
-static std::string extract(const std::string& src, const std::string& key) {
-    auto pos = src.find(key);
-    if (pos == std::string::npos) return "N/A";
-    pos = src.find(':', pos);
-    if (pos == std::string::npos) return "N/A";
-    auto end = src.find_first_of(",}", pos + 1);
-    if (end == std::string::npos) end = src.size();
-
-    std::string raw = src.substr(pos + 1, end - pos - 1);
-    size_t start = raw.find_first_not_of(" \"\t");
-    size_t finish = raw.find_last_not_of(" \"\t");
-    if (start == std::string::npos || finish == std::string::npos) return "N/A";
-    return raw.substr(start, finish - start + 1);
-}
-
 // I read the API key from the environment so secrets never live in code.
 std::string WeatherClient::getApiKey() const {
     const char* key = std::getenv("WEATHERAPI_KEY");
     return key ? std::string(key) : std::string();
 }
 
-std::string WeatherClient::getWeather(const std::string& city) {
-    std::string apiKey = getApiKey();
-    if (apiKey.empty()) {
-        return "WEATHERAPI_KEY not set";
+// I percent-encode the city so names with spaces or accents
+// still form a valid request target.
+static std::string urlEncode(const std::string& value) {
+    static const char* hex = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(value.size());
+    for (unsigned char c : value) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out.push_back(static_cast<char>(c));
+        } else {
+            out.push_back('%');
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0x0F]);
+        }
     }
+    return out;
+}
 
-    try {
-        const std::string host = "api.weatherapi.com";
-        const std::string port = "443";
-        const std::string target = "/v1/current.json?key=" + apiKey + "&q=" + city;
+WeatherClient::WeatherClient() : upstream(UpstreamOptions::fromEnvironment()) {}
 
-        boost::asio::io_context ioc;
-        boost::asio::ssl::context ctx{boost::asio::ssl::context::tls_client};
+WeatherClient::WeatherClient(const UpstreamOptions& options) : upstream(options) {}
 
-        // I rely on system trust stores to validate HTTPS certificates.
-        ctx.set_default_verify_paths();
+WeatherClient::WeatherClient(const WeatherClientOptions& options)
+    : upstream(options.upstream), hedging(options.hedging), circuit(options.breaker) {
+    if (hedging.maxRatio > 0.0) {
+        hedgePool = std::make_unique<boost::asio::thread_pool>(std::max(2u, hedging.threads));
+    }
+}
+
+// I wait for attempts still running on the hedge pool, since they
+// use the upstream client and the metrics.
+WeatherClient::~WeatherClient() {
+    if (hedgePool) hedgePool->join();
+}
 
-        boost::asio::ssl::stream<tcp::socket> stream{ioc, ctx};
+std::string WeatherClient::getWeather(const std::string& city) {
+    WeatherObservation observation;
+    std::string error;
+    if (!tryGetWeather(city, observation, error)) return error;
+    return observation.summary();
+}
 
-        tcp::resolver resolver{ioc};
-        auto const results = resolver.resolve(host, port);
-        boost::asio::connect(stream.next_layer(), results.begin(), results.end());
+WeatherClient::Attempt WeatherClient::attempt(const std::string& target) {
+    Attempt result;
+    try {
+        ScopedLatency timer(&upstreamMetrics.latency);
+        TraceSpan span("upstream request");
+        result.res = upstream.get(target);
+
+        // I count 5xx and 429 (quota) as the upstream being unwell;
+        // other errors are answers about the lookup itself.
+        unsigned status = result.res.result_int();
+        result.unavailable = status >= 500 || status == 429;
+    }
+    catch (const UpstreamTimeout& ex) {
+        upstreamMetrics.timeouts.fetch_add(1, std::memory_order_relaxed);
+        result.error = ex.what();
+        result.unavailable = true;
+    }
+    catch (const std::exception& ex) {
+        result.error = ex.what();
+        result.unavailable = true;
+    }
+    return result;
+}
 
-        // I explicitly perform the TLS handshake before sending the request.
-        stream.handshake(boost::asio::ssl::stream_base::client);
+WeatherClient::Attempt WeatherClient::hedgedAttempt(const std::string& target) {
+    // I share the race with the attempts, which may outlive this call:
+    // the loser keeps running until its own deadline.
+    struct Race {
+        std::mutex mutex;
+        std::condition_variable settled;
+        unsigned running = 0;
+        bool done = false;
+        bool hedgeWon = false;
+        Attempt winner;
+    };
+    auto race = std::make_shared<Race>();
+    std::uint64_t traceId = Tracer::currentTrace();
+
+    auto launch = [this, race, &target, traceId](bool hedge) {
+        race->running++;
+        boost::asio::post(*hedgePool, [this, race, target, traceId, hedge] {
+            TraceContext context(traceId);
+            Attempt result = attempt(target);
+
+            // I settle on the first answer, or on the last failure.
+            std::lock_guard<std::mutex> lock(race->mutex);
+            --race->running;
+            if (race->done || (result.unavailable && race->running > 0)) return;
+            race->winner = std::move(result);
+            race->hedgeWon = hedge;
+            race->done = true;
+            race->settled.notify_all();
+        });
+    };
+
+    std::unique_lock<std::mutex> lock(race->mutex);
+    launch(false);
+
+    // I hedge after the chosen quantile of past calls, once there are
+    // enough to trust it, and only while within the hedge budget.
+    std::uint64_t samples = 0;
+    double delay = upstreamMetrics.latency.quantileSeconds(hedging.quantile, samples);
+    std::uint64_t eligible = hedgeEligible.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (samples >= hedging.minSamples && std::isfinite(delay)) {
+        auto wait = std::max<std::chrono::nanoseconds>(
+            hedging.minDelay, std::chrono::nanoseconds(static_cast<std::int64_t>(delay * 1e9)));
+        if (!race->settled.wait_for(lock, wait, [&] { return race->done; }) &&
+            static_cast<double>(upstreamMetrics.hedges.load(std::memory_order_relaxed) + 1) <=
+                hedging.maxRatio * static_cast<double>(eligible)) {
+            upstreamMetrics.hedges.fetch_add(1, std::memory_order_relaxed);
+            launch(true);
+        }
+    }
 
-        http::request<http::string_body> req{http::verb::get, target, 11};
-        req.set(http::field::host, host);
-        req.set(http::field::user_agent, "WeatherApp");
+    race->settled.wait(lock, [&] { return race->done; });
+    if (race->hedgeWon) upstreamMetrics.hedgeWins.fetch_add(1, std::memory_order_relaxed);
+    return std::move(race->winner);
+}
 
-        http::write(stream, req);
+bool WeatherClient::tryGetWeather(const std::string& city, WeatherObservation& out, std::string& outError,
+                                  bool* unavailable) {
+    std::string apiKey = getApiKey();
+    if (apiKey.empty()) {
+        outError = "WEATHERAPI_KEY not set";
+        return false;
+    }
 
-        boost::beast::flat_buffer buffer;
-        http::response<http::string_body> res;
-        http::read(stream, buffer, res);
+    if (unavailable) *unavailable = false;
 
-        boost::system::error_code ec;
-        stream.shutdown(ec);
+    // I fail fast while the upstream is known to be down; the caller
+    // may still have an older reading to fall back on.
+    if (!circuit.allow()) {
+        upstreamMetrics.failures.fetch_add(1, std::memory_order_relaxed);
+        outError = "Error: weather service unavailable, please retry shortly.";
+        if (unavailable) *unavailable = true;
+        return false;
+    }
 
-        // I format a short, human-readable summary instead of returning raw JSON.
-        std::string body = res.body();
-        std::ostringstream out;
-        out << "Weather in " << city
-            << " | Temp " << extract(body, "\"temp_c\"")
-            << " C | Wind " << extract(body, "\"wind_kph\"")
-            << " kph";
-        return out.str();
+    bool reported = false;
+    try {
+        const std::string target = "/v1/current.json?key=" + apiKey + "&q=" + urlEncode(city);
+
+        // I go through the pooled client so most calls reuse a warm connection.
+        Attempt result = hedgePool ? hedgedAttempt(target) : attempt(target);
+        if (result.unavailable) circuit.onFailure();
+        else circuit.onSuccess();
+        reported = true;
+        if (unavailable) *unavailable = result.unavailable;
+
+        if (!result.error.empty()) {
+            upstreamMetrics.failures.fetch_add(1, std::memory_order_relaxed);
+            outError = "Error: " + result.error;
+            return false;
+        }
+        const UpstreamClient::Response& res = result.res;
+
+        // I treat non-200 replies (unknown city, bad key) as failures
+        // so they are never cached as if they were real weather.
+        if (res.result() != http::status::ok) {
+            std::string message;
+            upstreamMetrics.failures.fetch_add(1, std::memory_order_relaxed);
+            outError = WeatherObservation::parseError(res.body(), message)
+                ? "Error: " + message
+                : "Error: upstream returned HTTP " + std::to_string(res.result_int());
+            return false;
+        }
+
+        // I parse straight out of the response buffer in one pass.
+        TraceSpan span("parse upstream response");
+        if (!WeatherObservation::parse(res.body(), out)) {
+            upstreamMetrics.failures.fetch_add(1, std::memory_order_relaxed);
+            outError = "Error: malformed upstream response";
+            return false;
+        }
+        out.city = city;
+        return true;
     }
     catch (const std::exception& ex) {
         // I surface failures as text so callers can display them directly.
-        return std::string("Error: ") + ex.what();
+        if (!reported) circuit.onFailure();
+        upstreamMetrics.failures.fetch_add(1, std::memory_order_relaxed);
+        outError = std::string("Error: ") + ex.what();
+        return false;
     }
 }
@@ -1,15 +1,102 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
 
-// I keep WeatherClient focused solely on fetching and formatting weather data.
+#include <boost/asio/thread_pool.hpp>
+
+#include "CircuitBreaker.h"
+#include "Metrics.h"
+#include "UpstreamClient.h"
+#include "WeatherObservation.h"
+
+// I count upstream calls and how long they take, failures included.
+struct UpstreamMetrics {
+    LatencyHistogram latency;
+    std::atomic<std::uint64_t> failures{0};
+    std::atomic<std::uint64_t> timeouts{0};
+    std::atomic<std::uint64_t> hedges{0};
+    std::atomic<std::uint64_t> hedgeWins{0};
+};
+
+// I describe hedged requests: when a call has not answered after the
+// upstream's usual slow latency, a second one is sent and whichever
+// answers first wins. The ratio caps the extra load.
+struct HedgeOptions {
+    // I hedge at most this fraction of lookups; zero turns hedging off.
+    double maxRatio = 0.0;
+
+    // I wait for this latency quantile of past calls before hedging...
+    double quantile = 0.95;
+
+    // ...but never less than this, and only once enough calls were seen.
+    std::chrono::milliseconds minDelay{20};
+    std::uint64_t minSamples = 20;
+
+    // I run both attempts of a hedged lookup on this many threads.
+    unsigned threads = 64;
+};
+
+struct WeatherClientOptions {
+    UpstreamOptions upstream;
+    CircuitBreakerOptions breaker;
+    HedgeOptions hedging;
+};
+
+// I keep WeatherClient focused solely on fetching weather data.
 class WeatherClient {
 public:
+    // I default to the upstream named by WEATHERAPI_URL
+    // (or https://api.weatherapi.com when it is unset).
+    WeatherClient();
+    explicit WeatherClient(const UpstreamOptions& options);
+    explicit WeatherClient(const WeatherClientOptions& options);
+    ~WeatherClient();
+
     // I fetch current weather for a city using an API key
-    // provided through the environment.
+    // provided through the environment, and return its summary
+    // or the error text.
     std::string getWeather(const std::string& city);
 
+    // I report whether the lookup succeeded so callers such as the cache
+    // can tell a real observation from a failure. On failure outError
+    // holds text that can be shown to the user as-is, and unavailable
+    // (when given) tells whether the upstream could not answer at all
+    // (timeout, 5xx, open breaker) rather than rejected the lookup.
+    bool tryGetWeather(const std::string& city, WeatherObservation& out, std::string& outError,
+                       bool* unavailable = nullptr);
+
+    const UpstreamMetrics& metrics() const { return upstreamMetrics; }
+    const CircuitBreaker& breaker() const { return circuit; }
+
 private:
+    // I hold the outcome of one upstream call.
+    struct Attempt {
+        UpstreamClient::Response res;
+        std::string error;      // transport failure text, empty if res is valid
+        bool unavailable = false;
+    };
+
     // I isolate API key access so secrets stay out of call sites.
     std::string getApiKey() const;
+
+    // I make one call on the calling thread.
+    Attempt attempt(const std::string& target);
+
+    // I race a second call against the first once it runs late.
+    Attempt hedgedAttempt(const std::string& target);
+
+    // I reuse connections, DNS results and TLS sessions across calls.
+    UpstreamClient upstream;
+
+    HedgeOptions hedging;
+    CircuitBreaker circuit;
+    UpstreamMetrics upstreamMetrics;
+
+    // I only exist when hedging is on.
+    std::unique_ptr<boost::asio::thread_pool> hedgePool;
+    std::atomic<std::uint64_t> hedgeEligible{0};
 };
@@ -0,0 +1,213 @@
+#include "WeatherObservation.h"
+#include "JsonWriter.h"
+
+#include <cstdio>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+std::string WeatherObservation::summary() const {
+    char numbers[96];
+    int length = std::snprintf(numbers, sizeof(numbers), " | Temp %.1f C | Wind %.1f kph", tempC, windKph);
+
+    // I size the text once; this runs for every logged lookup.
+    std::string text;
+    text.reserve(11 + city.size() + static_cast<std::size_t>(length));
+    text.append("Weather in ").append(city).append(numbers, static_cast<std::size_t>(length));
+    return text;
+}
+
+template <class String>
+static void appendObservation(const WeatherObservation& o, String& out) {
+    out.push_back('{');
+    json_writer::appendKey(out, "city");
+    json_writer::appendString(out, o.city);
+    out.push_back(',');
+    json_writer::appendKey(out, "tempC");
+    json_writer::appendNumber(out, o.tempC);
+    out.push_back(',');
+    json_writer::appendKey(out, "windKph");
+    json_writer::appendNumber(out, o.windKph);
+    out.push_back(',');
+    json_writer::appendKey(out, "humidity");
+    json_writer::appendNumber(out, static_cast<long long>(o.humidity));
+    out.push_back(',');
+    json_writer::appendKey(out, "conditionCode");
+    json_writer::appendNumber(out, static_cast<long long>(o.conditionCode));
+    out.push_back(',');
+    json_writer::appendKey(out, "condition");
+    json_writer::appendString(out, o.conditionText);
+    out.push_back(',');
+    json_writer::appendKey(out, "observedAt");
+    json_writer::appendNumber(out, static_cast<long long>(o.observedAt));
+    out.push_back('}');
+}
+
+void WeatherObservation::appendJson(std::string& out) const {
+    appendObservation(*this, out);
+}
+
+void WeatherObservation::appendJson(std::pmr::string& out) const {
+    appendObservation(*this, out);
+}
+
+namespace {
+
+// I only keep the fields I need, so I track where I am with a tiny
+// state machine instead of a key stack: which object I am in and which
+// key's value comes next. Everything else is skipped as it streams by.
+class ObservationSax : public nlohmann::json_sax<json> {
+public:
+    explicit ObservationSax(WeatherObservation& target) : out(target) {}
+
+    bool sawTemperature = false;
+
+    bool null() override { field = Field::none; return true; }
+    bool boolean(bool) override { field = Field::none; return true; }
+    bool number_integer(number_integer_t value) override { return number(static_cast<double>(value)); }
+    bool number_unsigned(number_unsigned_t value) override { return number(static_cast<double>(value)); }
+    bool number_float(number_float_t value, const string_t&) override { return number(value); }
+
+    bool string(string_t& value) override {
+        if (field == Field::conditionText) out.conditionText = std::move(value);
+        field = Field::none;
+        return true;
+    }
+
+    bool binary(binary_t&) override { return true; }
+
+    bool start_object(std::size_t) override {
+        ++depth;
+        if (depth == 2 && field == Field::current) scope = Scope::current;
+        else if (depth == 3 && scope == Scope::current && field == Field::condition) scope = Scope::condition;
+        field = Field::none;
+        return true;
+    }
+
+    bool end_object() override {
+        if (depth == 3 && scope == Scope::condition) scope = Scope::current;
+        else if (depth == 2 && scope == Scope::current) scope = Scope::none;
+        --depth;
+        return true;
+    }
+
+    bool start_array(std::size_t) override { ++depth; field = Field::none; return true; }
+    bool end_array() override { --depth; return true; }
+
+    bool key(string_t& name) override {
+        field = Field::none;
+        if (depth == 1) {
+            if (name == "current") field = Field::current;
+        } else if (depth == 2 && scope == Scope::current) {
+            if (name == "temp_c") field = Field::tempC;
+            else if (name == "wind_kph") field = Field::windKph;
+            else if (name == "humidity") field = Field::humidity;
+            else if (name == "last_updated_epoch") field = Field::observedAt;
+            else if (name == "condition") field = Field::condition;
+        } else if (depth == 3 && scope == Scope::condition) {
+            if (name == "code") field = Field::conditionCode;
+            else if (name == "text") field = Field::conditionText;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+        return false;
+    }
+
+private:
+    enum class Scope { none, current, condition };
+    enum class Field { none, current, condition, tempC, windKph, humidity, observedAt,
+                       conditionCode, conditionText };
+
+    bool number(double value) {
+        switch (field) {
+            case Field::tempC: out.tempC = value; sawTemperature = true; break;
+            case Field::windKph: out.windKph = value; break;
+            case Field::humidity: out.humidity = static_cast<int>(value); break;
+            case Field::observedAt: out.observedAt = static_cast<std::int64_t>(value); break;
+            case Field::conditionCode: out.conditionCode = static_cast<int>(value); break;
+            default: break;
+        }
+        field = Field::none;
+        return true;
+    }
+
+    WeatherObservation& out;
+    int depth = 0;
+    Scope scope = Scope::none;
+    Field field = Field::none;
+};
+
+// I look for {"error": {"message": "..."}} and nothing else.
+class ErrorSax : public nlohmann::json_sax<json> {
+public:
+    explicit ErrorSax(std::string& target) : out(target) {}
+
+    bool found = false;
+
+    bool null() override { wanted = false; return true; }
+    bool boolean(bool) override { wanted = false; return true; }
+    bool number_integer(number_integer_t) override { wanted = false; return true; }
+    bool number_unsigned(number_unsigned_t) override { wanted = false; return true; }
+    bool number_float(number_float_t, const string_t&) override { wanted = false; return true; }
+
+    bool string(string_t& value) override {
+        if (wanted) {
+            out = std::move(value);
+            found = true;
+        }
+        wanted = false;
+        return true;
+    }
+
+    bool binary(binary_t&) override { return true; }
+
+    bool start_object(std::size_t) override {
+        ++depth;
+        inError = inError || (depth == 2 && errorNext);
+        errorNext = wanted = false;
+        return true;
+    }
+
+    bool end_object() override {
+        if (depth == 2) inError = false;
+        --depth;
+        return true;
+    }
+
+    bool start_array(std::size_t) override { ++depth; errorNext = wanted = false; return true; }
+    bool end_array() override { --depth; return true; }
+
+    bool key(string_t& name) override {
+        errorNext = depth == 1 && name == "error";
+        wanted = depth == 2 && inError && name == "message";
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+        return false;
+    }
+
+private:
+    std::string& out;
+    int depth = 0;
+    bool inError = false;
+    bool errorNext = false;
+    bool wanted = false;
+};
+
+} // namespace
+
+bool WeatherObservation::parse(std::string_view body, WeatherObservation& out) {
+    ObservationSax handler(out);
+    bool wellFormed = json::sax_parse(body.begin(), body.end(), &handler);
+    return wellFormed && handler.sawTemperature;
+}
+
+bool WeatherObservation::parseError(std::string_view body, std::string& outMessage) {
+    ErrorSax handler(outMessage);
+    bool wellFormed = json::sax_parse(body.begin(), body.end(), &handler);
+    return wellFormed && handler.found;
+}
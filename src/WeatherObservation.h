@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+// I carry one current-conditions reading in typed form, so it can be
+// cached, compared and serialized without re-parsing upstream JSON.
+struct WeatherObservation {
+    std::string city;             // as the caller asked for it
+    double tempC = 0.0;
+    double windKph = 0.0;
+    int humidity = 0;             // percent
+    int conditionCode = 0;        // weatherapi.com condition code
+    std::string conditionText;
+    std::int64_t observedAt = 0;  // unix seconds of the upstream reading
+
+    // I build the human-readable one-liner only when someone shows it.
+    std::string summary() const;
+
+    // I append myself as a JSON object, the shape every endpoint shares.
+    // The pmr overload writes into a request arena (see RequestArena).
+    void appendJson(std::string& out) const;
+    void appendJson(std::pmr::string& out) const;
+
+    // I read a weatherapi.com current.json body in a single SAX pass,
+    // without building a DOM. Returns false on malformed JSON or when
+    // the temperature is missing. The city is left untouched.
+    static bool parse(std::string_view body, WeatherObservation& out);
+
+    // I pull error.message out of an upstream error body, if present.
+    static bool parseError(std::string_view body, std::string& outMessage);
+};
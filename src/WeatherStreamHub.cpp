@@ -0,0 +1,170 @@
+#include "WeatherStreamHub.h"
+#include "CityName.h"
+#include "JsonWriter.h"
+
+#include <algorithm>
+#include <exception>
+
+#include <boost/asio/post.hpp>
+
+namespace net = boost::asio;
+
+// I keep idle connections (and the proxies in between) alive with an SSE
+// comment when a refresh brings nothing new.
+static const WeatherStreamHub::Event& heartbeatEvent() {
+    static const WeatherStreamHub::Event event = std::make_shared<const std::string>(":\n\n");
+    return event;
+}
+
+// I use the /weather/current body as the event data, so clients parse
+// one shape whichever way they get it.
+static WeatherStreamHub::Event weatherEvent(const WeatherObservation& observation) {
+    std::string out = "event: weather\ndata: {";
+    json_writer::appendKey(out, "summary");
+    json_writer::appendString(out, observation.summary());
+    out.push_back(',');
+    json_writer::appendKey(out, "observation");
+    observation.appendJson(out);
+    out += "}\n\n";
+    return std::make_shared<const std::string>(std::move(out));
+}
+
+static WeatherStreamHub::Event errorEvent(const std::string& error) {
+    std::string out = "event: error\ndata: {";
+    json_writer::appendKey(out, "error");
+    json_writer::appendString(out, error);
+    out += "}\n\n";
+    return std::make_shared<const std::string>(std::move(out));
+}
+
+WeatherStreamHub::WeatherStreamHub(WeatherCache& cache, net::io_context& ioc,
+                                   net::thread_pool& pool, std::chrono::seconds refresh)
+    : weather(cache), workers(pool), timer(ioc), interval(refresh) {}
+
+void WeatherStreamHub::start() {
+    arm();
+}
+
+void WeatherStreamHub::stop() {
+    timer.cancel();
+}
+
+void WeatherStreamHub::arm() {
+    timer.expires_after(interval);
+    timer.async_wait([this](const boost::system::error_code& ec) {
+        if (ec) return;
+        refresh();
+        arm();
+    });
+}
+
+void WeatherStreamHub::refresh() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = topics.begin(); it != topics.end();) {
+        auto& subscribers = it->second.subscribers;
+        subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+                                         [](const auto& s) { return s.expired(); }),
+                          subscribers.end());
+        if (subscribers.empty()) {
+            it = topics.erase(it);
+            continue;
+        }
+
+        // I skip a city whose previous fetch is still running.
+        if (!it->second.fetching) {
+            it->second.fetching = true;
+            net::post(workers, [this, key = it->first] { fetch(key); });
+        }
+        ++it;
+    }
+}
+
+void WeatherStreamHub::subscribe(const std::string& city, const std::weak_ptr<StreamSubscriber>& subscriber) {
+    std::string key = normalizeCity(city);
+    Event latest;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Topic& topic = topics[key];
+        if (topic.city.empty()) topic.city = city;
+        topic.subscribers.push_back(subscriber);
+        latest = topic.latest;
+
+        if (!latest && !topic.fetching) {
+            topic.fetching = true;
+            net::post(workers, [this, key] { fetch(key); });
+        }
+    }
+
+    if (latest) {
+        if (auto live = subscriber.lock()) publish({ live }, latest);
+    }
+}
+
+void WeatherStreamHub::fetch(const std::string& key) {
+    std::string city;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = topics.find(key);
+        if (it == topics.end()) return;
+        city = it->second.city;
+    }
+
+    std::shared_ptr<const WeatherObservation> observation;
+    std::string error;
+    bool ok = false;
+    try {
+        ok = weather.getObservation(city, observation, error);
+    }
+    catch (const std::exception& e) {
+        error = std::string("Error: ") + e.what();
+    }
+
+    // I serialize outside the lock; an unchanged reading is swapped
+    // for a heartbeat below.
+    Event event = ok ? weatherEvent(*observation) : errorEvent(error);
+
+    std::vector<std::shared_ptr<StreamSubscriber>> targets;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = topics.find(key);
+        if (it == topics.end()) return;
+
+        Topic& topic = it->second;
+        topic.fetching = false;
+        if (ok) {
+            if (observation->observedAt == topic.observedAt) {
+                event = heartbeatEvent();
+            } else {
+                topic.observedAt = observation->observedAt;
+                topic.latest = event;
+            }
+        }
+
+        targets.reserve(topic.subscribers.size());
+        for (const auto& subscriber : topic.subscribers) {
+            if (auto live = subscriber.lock()) targets.push_back(std::move(live));
+        }
+    }
+
+    publish(targets, event);
+}
+
+void WeatherStreamHub::publish(const std::vector<std::shared_ptr<StreamSubscriber>>& targets,
+                               const Event& event) {
+    for (const auto& target : targets) target->deliver(event);
+    if (event != heartbeatEvent()) events.fetch_add(targets.size(), std::memory_order_relaxed);
+}
+
+WeatherStreamStats WeatherStreamHub::stats() const {
+    WeatherStreamStats out{ 0, 0, events.load(std::memory_order_relaxed),
+                            dropped.load(std::memory_order_relaxed) };
+
+    std::lock_guard<std::mutex> lock(mutex);
+    out.cities = topics.size();
+    for (const auto& entry : topics) {
+        for (const auto& subscriber : entry.second.subscribers) {
+            if (!subscriber.expired()) ++out.subscribers;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+#include "WeatherCache.h"
+
+// I receive ready-to-send Server-Sent Events. deliver may be called from
+// any thread and must only queue the event, never block on the network.
+class StreamSubscriber {
+public:
+    virtual ~StreamSubscriber() = default;
+    virtual void deliver(const std::shared_ptr<const std::string>& event) = 0;
+};
+
+// I expose plain counters so the server can report stream load.
+struct WeatherStreamStats {
+    std::size_t cities;
+    std::size_t subscribers;
+    std::uint64_t events;
+    std::uint64_t dropped;
+};
+
+// I keep one topic per city with live subscribers. Every refresh I look
+// each topic up once (through the cache), serialize the result once and
+// hand the same bytes to every subscriber. Subscribers are held weakly,
+// so a closed connection simply disappears from its topic, and a topic
+// with nobody left stops being fetched.
+class WeatherStreamHub {
+public:
+    using Event = std::shared_ptr<const std::string>;
+
+    WeatherStreamHub(WeatherCache& weather, boost::asio::io_context& ioc,
+                     boost::asio::thread_pool& workers, std::chrono::seconds refresh);
+
+    // I start and stop the refresh timer.
+    void start();
+    void stop();
+
+    // I add a subscriber to a city's topic and send it the latest event
+    // right away, or fetch one now if the topic is new.
+    void subscribe(const std::string& city, const std::weak_ptr<StreamSubscriber>& subscriber);
+
+    // I count subscribers their connection dropped for falling behind.
+    void noteDropped() { dropped.fetch_add(1, std::memory_order_relaxed); }
+
+    WeatherStreamStats stats() const;
+
+private:
+    struct Topic {
+        std::string city;  // as the first subscriber spelled it
+        std::vector<std::weak_ptr<StreamSubscriber>> subscribers;
+        Event latest;
+        std::int64_t observedAt = -1;
+        bool fetching = false;
+    };
+
+    void arm();
+    void refresh();
+
+    // I run on the worker pool since a cache miss goes upstream.
+    void fetch(const std::string& key);
+
+    // I send one event to a batch of subscribers, outside the lock.
+    void publish(const std::vector<std::shared_ptr<StreamSubscriber>>& targets, const Event& event);
+
+    WeatherCache& weather;
+    boost::asio::thread_pool& workers;
+    boost::asio::steady_timer timer;
+    std::chrono::seconds interval;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Topic> topics;
+
+    std::atomic<std::uint64_t> events{0};
+    std::atomic<std::uint64_t> dropped{0};
+};
@@ -1,16 +1,104 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <cstdlib>
 #include <string>
 
 #include "WeatherClient.h"
+#include "WeatherCache.h"
 #include "AuthService.h"
 #include "Database.h"
 #include "HttpServer.h"
+#include "BatchRunner.h"
 
 // I keep usage printing separate so argument handling stays readable.
 void printUsage() {
     std::cout << "Usage:\n"
-              << "  WeatherApp --cli\n"
-              << "  WeatherApp --server <address> <port>\n";
+              << "  WeatherApp --cli [--cache-ttl SECONDS] [--cache-size N]\n"
+              << "                    [--retention-days N] [--retention-archive PATH]\n"
+              << "  WeatherApp --batch <file|-> [--concurrency N] [--order input|completion]\n"
+              << "                    [--user NAME] [--cache-size N] [--max-upstream-fetches N]\n"
+              << "  WeatherApp --server <address> <port> [--threads N] [--workers N]\n"
+              << "                       [--idle-timeout SECONDS] [--max-requests N]\n"
+              << "                       [--cache-ttl SECONDS] [--cache-size N]\n"
+              << "                       [--session-idle-ttl SECONDS] [--session-ttl SECONDS]\n"
+              << "                       [--max-sessions-per-user N]\n"
+              << "                       [--batch-parallelism N] [--batch-deadline-ms MS]\n"
+              << "                       [--stream-refresh SECONDS]\n"
+              << "                       [--trace-sample N] [--trace-buffer SPANS]\n"
+              << "                       [--compress-min-bytes N] [--compress-level 0-9]\n"
+              << "                       [--token-rate N] [--token-burst N]\n"
+              << "                       [--ip-rate N] [--ip-burst N]\n"
+              << "                       [--queue-budget-ms MS] [--max-upstream-fetches N]\n"
+              << "                       [--upstream-connect-timeout-ms MS] [--upstream-timeout-ms MS]\n"
+              << "                       [--breaker-failures N] [--breaker-open-seconds SECONDS]\n"
+              << "                       [--hedge-percent N] [--max-stale SECONDS]\n"
+              << "                       [--retention-days N] [--retention-archive PATH]\n";
+}
+
+// I parse trailing "--name value" pairs into option structs so the
+// positional arguments stay exactly as before.
+bool parseOptions(int argc, char* argv[], int first, ServerOptions& options,
+                  WeatherCacheOptions& cacheOptions, DatabaseOptions& dbOptions,
+                  WeatherClientOptions& clientOptions, BatchOptions& batchOptions,
+                  std::string& batchUser) {
+    for (int i = first; i < argc; i += 2) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) return false;
+        if (flag == "--retention-archive") {
+            dbOptions.retention.archivePath = argv[i + 1];
+            continue;
+        }
+        if (flag == "--user") {
+            batchUser = argv[i + 1];
+            continue;
+        }
+        if (flag == "--order") {
+            std::string order = argv[i + 1];
+            if (order != "input" && order != "completion") return false;
+            batchOptions.completionOrder = order == "completion";
+            continue;
+        }
+        unsigned value = static_cast<unsigned>(std::stoul(argv[i + 1]));
+
+        if (flag == "--threads") options.ioThreads = value;
+        else if (flag == "--workers") options.workerThreads = value;
+        else if (flag == "--idle-timeout") options.idleTimeout = std::chrono::seconds(value);
+        else if (flag == "--max-requests") options.maxRequestsPerConnection = value;
+        else if (flag == "--session-idle-ttl") options.sessions.idleTtl = std::chrono::seconds(value);
+        else if (flag == "--session-ttl") options.sessions.absoluteTtl = std::chrono::seconds(value);
+        else if (flag == "--max-sessions-per-user") options.sessions.maxSessionsPerUser = std::max(1u, value);
+        else if (flag == "--batch-parallelism") options.batchParallelism = value;
+        else if (flag == "--batch-deadline-ms") options.batchDeadline = std::chrono::milliseconds(value);
+        else if (flag == "--stream-refresh") options.streamRefresh = std::chrono::seconds(std::max(1u, value));
+        else if (flag == "--trace-sample") options.tracing.sampleEvery = value;
+        else if (flag == "--trace-buffer") options.tracing.spansPerThread = value;
+        else if (flag == "--compress-min-bytes") options.compressMinBytes = value;
+        else if (flag == "--compress-level") options.compressionLevel = static_cast<int>(std::min(9u, value));
+        else if (flag == "--token-rate") options.tokenRateLimit.perSecond = value;
+        else if (flag == "--token-burst") options.tokenRateLimit.burst = value;
+        else if (flag == "--ip-rate") options.ipRateLimit.perSecond = value;
+        else if (flag == "--ip-burst") options.ipRateLimit.burst = value;
+        else if (flag == "--queue-budget-ms") options.queueBudget = std::chrono::milliseconds(value);
+        else if (flag == "--max-upstream-fetches") cacheOptions.maxConcurrentFetches = value;
+        else if (flag == "--upstream-connect-timeout-ms") {
+            clientOptions.upstream.resolveTimeout = std::chrono::milliseconds(value);
+            clientOptions.upstream.connectTimeout = std::chrono::milliseconds(value);
+            clientOptions.upstream.handshakeTimeout = std::chrono::milliseconds(value);
+        }
+        else if (flag == "--upstream-timeout-ms") clientOptions.upstream.responseTimeout = std::chrono::milliseconds(value);
+        else if (flag == "--breaker-failures") clientOptions.breaker.failureThreshold = value;
+        else if (flag == "--breaker-open-seconds") clientOptions.breaker.openFor = std::chrono::seconds(value);
+        else if (flag == "--hedge-percent") clientOptions.hedging.maxRatio = std::min(100u, value) / 100.0;
+        else if (flag == "--max-stale") cacheOptions.maxStale = std::chrono::seconds(value);
+        else if (flag == "--concurrency") batchOptions.concurrency = value;
+        else if (flag == "--cache-ttl") cacheOptions.ttl = std::chrono::seconds(value);
+        else if (flag == "--cache-size") cacheOptions.capacity = value;
+        else if (flag == "--retention-days") dbOptions.retention.maxAge = std::chrono::hours(24 * value);
+        else return false;
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -23,12 +111,35 @@ int main(int argc, char* argv[]) {
     std::string mode = argv[1];
 
     try {
+        // I parse options before opening the database, since retention
+        // is decided when it opens. Server mode has two positionals,
+        // batch mode one.
+        ServerOptions options;
+        WeatherCacheOptions cacheOptions;
+        DatabaseOptions dbOptions;
+        WeatherClientOptions clientOptions;
+        clientOptions.upstream = UpstreamOptions::fromEnvironment();
+        BatchOptions batchOptions;
+        std::string batchUser;
+
+        int first = mode == "--server" ? 4 : mode == "--batch" ? 3 : 2;
+        if (argc < first || !parseOptions(argc, argv, first, options, cacheOptions, dbOptions,
+                                          clientOptions, batchOptions, batchUser)) {
+            printUsage();
+            return 1;
+        }
+
         // I create shared services once and reuse them across modes.
-        Database db("weather.db");
+        Database db("weather.db", dbOptions);
         AuthService auth(db);
 
+        WeatherClient client(clientOptions);
+
         if (mode == "--cli") {
-            WeatherClient weather;
+
+            // I route CLI lookups through the same cache as the server
+            // so repeated cities do not spend upstream quota.
+            WeatherCache weather(client, cacheOptions);
 
             std::cout << "Welcome to WeatherApp CLI\n";
 
@@ -69,28 +180,79 @@ int main(int argc, char* argv[]) {
                         std::cin >> city;
                         if (city == "back") break;
 
-                        std::string summary = weather.getWeather(city);
+                        std::shared_ptr<const WeatherObservation> observation;
+                        std::string error;
+                        bool ok = weather.getObservation(city, observation, error);
+                        std::string summary = ok ? observation->summary() : error;
                         std::cout << summary << "\n";
 
-                        db.logQuery(userId, city, summary);
+                        db.logQuery(userId, city, summary, ok ? observation.get() : nullptr);
                     }
                 }
             }
         }
         else if (mode == "--server") {
-            // I validate arguments early to fail fast on misconfiguration.
-            if (argc != 4) {
-                printUsage();
-                return 1;
+            // I read signing keys from the environment, like the API key,
+            // so secrets never appear on the command line.
+            if (const char* keys = std::getenv("WEATHERAPP_TOKEN_KEYS")) {
+                if (!TokenSigner::parseKeys(keys, options.sessions.signingKeys)) {
+                    std::cerr << "WEATHERAPP_TOKEN_KEYS must look like id1:secret1,id2:secret2\n";
+                    return 1;
+                }
             }
 
             std::string address = argv[2];
             int port = std::stoi(argv[3]);
 
             // I hand ownership of shared services to the server via references.
-            HttpServer server(address, port, db, auth);
+            WeatherCache weather(client, cacheOptions);
+            HttpServer server(address, port, db, auth, weather, options);
             server.run();
         }
+        else if (mode == "--batch") {
+            // I log under the named user, or under a "batch" account created
+            // on first use. Its password "!" is never a SHA-256 hex digest,
+            // so nobody can log in as it.
+            if (batchUser.empty()) {
+                batchUser = "batch";
+                if (db.findUser(batchUser) < 0) db.createUser(batchUser, "!");
+            }
+            batchOptions.userId = db.findUser(batchUser);
+            if (batchOptions.userId < 0) {
+                std::cerr << "Unknown user: " << batchUser << "\n";
+                return 1;
+            }
+
+            // I never start more lookups than the cache lets reach upstream,
+            // or the extra ones would only be shed.
+            if (cacheOptions.maxConcurrentFetches > 0) {
+                batchOptions.concurrency = static_cast<unsigned>(std::min<std::size_t>(
+                    batchOptions.concurrency, cacheOptions.maxConcurrentFetches));
+            }
+
+            std::string path = argv[2];
+            std::ifstream file;
+            if (path != "-") {
+                file.open(path);
+                if (!file) {
+                    std::cerr << "Cannot open " << path << "\n";
+                    return 1;
+                }
+            }
+            std::istream& in = path == "-" ? std::cin : file;
+
+            // I keep stdout for NDJSON only; the tally goes to stderr.
+            std::ios::sync_with_stdio(false);
+            auto start = std::chrono::steady_clock::now();
+
+            WeatherCache weather(client, cacheOptions);
+            BatchRunner runner(weather, db, batchOptions);
+            BatchSummary summary = runner.run(in, std::cout);
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cerr << "Looked up " << summary.cities << " cities (" << summary.ok << " ok, "
+                      << summary.failed << " failed) in " << seconds << " s\n";
+        }
         else {
             printUsage();
             return 1;
@@ -0,0 +1,298 @@
+// I drive a running WeatherApp server over keep-alive connections and
+// report latency percentiles and throughput per endpoint.
+//
+//   weather_loadgen --port 8080 --connections 32 --duration 10
+//                   --mix weather=70,history=20,health=10
+//
+// Each connection is a closed loop (send, wait for the answer, repeat),
+// so latencies are per request and throughput is what the server sustains
+// for that many concurrent clients.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <nlohmann/json.hpp>
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+using tcp = boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+enum Operation { kWeather, kHistory, kHealth, kBatch, kOperationCount };
+
+static const char* kOperationNames[kOperationCount] = { "weather", "history", "health", "batch" };
+
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    unsigned connections = 16;
+    std::chrono::seconds duration{10};
+    std::chrono::seconds warmup{1};
+    unsigned mix[kOperationCount] = { 70, 20, 10, 0 };
+    std::vector<std::string> cities = { "Helsinki", "Paris", "Tokyo", "Lima", "Oslo",
+                                        "Cairo", "Sydney", "Toronto", "Nairobi", "Seoul" };
+    std::string username = "loadgen";
+    std::string password = "loadgen-password";
+};
+
+// I keep raw samples per thread and merge them at the end; a run is
+// short enough that this is simpler than a histogram and exact.
+struct ThreadStats {
+    std::vector<std::uint32_t> latencyUs[kOperationCount];
+    std::uint64_t errors[kOperationCount] = {};
+};
+
+static bool parseMix(const std::string& spec, unsigned (&mix)[kOperationCount]) {
+    std::fill(std::begin(mix), std::end(mix), 0u);
+    std::stringstream in(spec);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        auto eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        std::string name = item.substr(0, eq);
+        unsigned weight = static_cast<unsigned>(std::stoul(item.substr(eq + 1)));
+
+        int op = -1;
+        for (int i = 0; i < kOperationCount; ++i) {
+            if (name == kOperationNames[i]) op = i;
+        }
+        if (op < 0) return false;
+        mix[op] = weight;
+    }
+    unsigned total = 0;
+    for (unsigned weight : mix) total += weight;
+    return total > 0;
+}
+
+class Client {
+public:
+    Client(net::io_context& ioc, const LoadOptions& opts) : stream(ioc), options(opts) {}
+
+    http::response<http::string_body> send(http::verb method, const std::string& target,
+                                           const std::string& body, const std::string& token) {
+        if (!connected) connect();
+
+        http::request<http::string_body> req{ method, target, 11 };
+        req.set(http::field::host, options.host);
+        req.keep_alive(true);
+        if (!token.empty()) req.set(http::field::authorization, "Bearer " + token);
+        if (!body.empty()) {
+            req.set(http::field::content_type, "application/json");
+            req.body() = body;
+        }
+        req.prepare_payload();
+
+        http::response<http::string_body> res;
+        try {
+            http::write(stream, req);
+            http::read(stream, buffer, res);
+        }
+        catch (...) {
+            // I reconnect on the next call; the server may have closed
+            // the connection after --max-requests.
+            connected = false;
+            throw;
+        }
+        if (!res.keep_alive()) disconnect();
+        return res;
+    }
+
+private:
+    void connect() {
+        tcp::resolver resolver(stream.get_executor());
+        buffer.clear();
+        stream.connect(resolver.resolve(options.host, options.port));
+        stream.socket().set_option(tcp::no_delay(true));
+        connected = true;
+    }
+
+    void disconnect() {
+        beast::error_code ec;
+        stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+        stream.close();
+        connected = false;
+    }
+
+    beast::tcp_stream stream;
+    const LoadOptions& options;
+    beast::flat_buffer buffer;
+    bool connected = false;
+};
+
+static std::string login(const LoadOptions& options) {
+    net::io_context ioc;
+    Client client(ioc, options);
+    nlohmann::json credentials{ {"username", options.username}, {"password", options.password} };
+
+    // I ignore the result: the user usually exists from an earlier run.
+    client.send(http::verb::post, "/auth/register", credentials.dump(), "");
+    auto res = client.send(http::verb::post, "/auth/login", credentials.dump(), "");
+    if (res.result() != http::status::ok) throw std::runtime_error("login failed: " + res.body());
+    return nlohmann::json::parse(res.body()).at("token").get<std::string>();
+}
+
+static void runConnection(const LoadOptions& options, const std::string& token, unsigned index,
+                          Clock::time_point measureFrom, Clock::time_point stopAt, ThreadStats& stats) {
+    net::io_context ioc;
+    Client client(ioc, options);
+
+    // I seed per connection so a run's request sequence is reproducible.
+    std::mt19937 rng(index * 7919u + 1u);
+    std::discrete_distribution<int> pick(std::begin(options.mix), std::end(options.mix));
+    std::uniform_int_distribution<std::size_t> city(0, options.cities.size() - 1);
+
+    while (Clock::now() < stopAt) {
+        int op = pick(rng);
+        http::verb method = http::verb::get;
+        std::string target, body;
+
+        switch (op) {
+            case kWeather:
+                method = http::verb::post;
+                target = "/weather/current";
+                body = nlohmann::json{ {"city", options.cities[city(rng)]} }.dump();
+                break;
+            case kHistory:
+                target = "/history?limit=20";
+                break;
+            case kHealth:
+                target = "/health";
+                break;
+            case kBatch: {
+                method = http::verb::post;
+                target = "/weather/batch";
+                nlohmann::json list = nlohmann::json::array();
+                for (int i = 0; i < 5; ++i) list.push_back(options.cities[city(rng)]);
+                body = nlohmann::json{ {"cities", list} }.dump();
+                break;
+            }
+        }
+
+        auto start = Clock::now();
+        bool ok = false;
+        try {
+            auto res = client.send(method, target, body, token);
+            ok = res.result_int() < 400;
+        }
+        catch (const std::exception&) {
+        }
+        auto end = Clock::now();
+
+        if (start < measureFrom) continue;
+        if (!ok) ++stats.errors[op];
+        stats.latencyUs[op].push_back(static_cast<std::uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()));
+    }
+}
+
+static double percentile(const std::vector<std::uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    std::size_t rank = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[rank] / 1000.0;
+}
+
+static void report(const char* name, std::vector<std::uint32_t>& samples, std::uint64_t errors, double seconds) {
+    std::sort(samples.begin(), samples.end());
+    std::printf("  %-8s %9zu %10.0f %8llu %9.2f %9.2f %9.2f %9.2f\n",
+                name, samples.size(), samples.size() / seconds, static_cast<unsigned long long>(errors),
+                percentile(samples, 0.50), percentile(samples, 0.99), percentile(samples, 0.999),
+                samples.empty() ? 0.0 : samples.back() / 1000.0);
+}
+
+static void printUsage() {
+    std::printf("Usage: weather_loadgen [--host H] [--port N] [--connections N] [--duration S]\n"
+                "                       [--warmup S] [--mix weather=70,history=20,health=10,batch=0]\n"
+                "                       [--cities A,B,C] [--user NAME]\n");
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    for (int i = 1; i < argc; i += 2) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+        std::string value = argv[i + 1];
+
+        if (flag == "--host") options.host = value;
+        else if (flag == "--port") options.port = value;
+        else if (flag == "--connections") options.connections = static_cast<unsigned>(std::stoul(value));
+        else if (flag == "--duration") options.duration = std::chrono::seconds(std::stoul(value));
+        else if (flag == "--warmup") options.warmup = std::chrono::seconds(std::stoul(value));
+        else if (flag == "--user") options.username = value;
+        else if (flag == "--mix") {
+            if (!parseMix(value, options.mix)) {
+                printUsage();
+                return 1;
+            }
+        }
+        else if (flag == "--cities") {
+            options.cities.clear();
+            std::stringstream in(value);
+            std::string cityName;
+            while (std::getline(in, cityName, ',')) options.cities.push_back(cityName);
+        }
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (options.connections == 0 || options.cities.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    try {
+        std::string token = login(options);
+
+        std::vector<ThreadStats> stats(options.connections);
+        auto measureFrom = Clock::now() + options.warmup;
+        auto stopAt = measureFrom + options.duration;
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < options.connections; ++i) {
+            threads.emplace_back(runConnection, std::cref(options), std::cref(token), i,
+                                 measureFrom, stopAt, std::ref(stats[i]));
+        }
+        for (auto& t : threads) t.join();
+
+        double seconds = std::chrono::duration<double>(options.duration).count();
+        std::printf("%u connections, %.0f s (after %lld s warmup)\n", options.connections, seconds,
+                    static_cast<long long>(options.warmup.count()));
+        std::printf("  %-8s %9s %10s %8s %9s %9s %9s %9s\n",
+                    "endpoint", "requests", "req/s", "errors", "p50 ms", "p99 ms", "p999 ms", "max ms");
+
+        std::vector<std::uint32_t> all;
+        std::uint64_t allErrors = 0;
+        for (int op = 0; op < kOperationCount; ++op) {
+            std::vector<std::uint32_t> merged;
+            std::uint64_t errors = 0;
+            for (auto& s : stats) {
+                merged.insert(merged.end(), s.latencyUs[op].begin(), s.latencyUs[op].end());
+                errors += s.errors[op];
+            }
+            if (merged.empty()) continue;
+            all.insert(all.end(), merged.begin(), merged.end());
+            allErrors += errors;
+            report(kOperationNames[op], merged, errors, seconds);
+        }
+        report("total", all, allErrors, seconds);
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "Fatal error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
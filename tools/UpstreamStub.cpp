@@ -0,0 +1,249 @@
+// I stand in for api.weatherapi.com so the server can be run and load
+// tested offline. Point WeatherClient at me with
+//   WEATHERAPI_URL=http://127.0.0.1:19000 WEATHERAPI_KEY=anything
+//
+// Answers are deterministic: the same city always gets the same reading,
+// cities starting with "unknown" get weatherapi's 400 "no match" error,
+// and a missing key gets its 401.
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+using tcp = boost::asio::ip::tcp;
+
+struct StubOptions {
+    std::string address = "127.0.0.1";
+    unsigned short port = 19000;
+    unsigned threads = 2;
+
+    // I delay every answer by this much to mimic a real upstream.
+    std::chrono::milliseconds latency{0};
+};
+
+static const char* kConditions[][2] = {
+    { "1000", "Sunny" }, { "1003", "Partly cloudy" }, { "1006", "Cloudy" },
+    { "1063", "Patchy rain possible" }, { "1183", "Light rain" }, { "1213", "Light snow" },
+};
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// I pull one decoded query parameter out of the target.
+static std::string queryParam(std::string_view target, std::string_view name) {
+    auto q = target.find('?');
+    if (q == std::string_view::npos) return "";
+    std::string_view query = target.substr(q + 1);
+
+    while (!query.empty()) {
+        auto amp = query.find('&');
+        std::string_view pair = query.substr(0, amp);
+        query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
+
+        auto eq = pair.find('=');
+        if (pair.substr(0, eq) != name || eq == std::string_view::npos) continue;
+
+        std::string value;
+        std::string_view raw = pair.substr(eq + 1);
+        for (std::size_t i = 0; i < raw.size(); ++i) {
+            if (raw[i] == '%' && i + 2 < raw.size() && hexValue(raw[i + 1]) >= 0 && hexValue(raw[i + 2]) >= 0) {
+                value.push_back(static_cast<char>(hexValue(raw[i + 1]) * 16 + hexValue(raw[i + 2])));
+                i += 2;
+            } else {
+                value.push_back(raw[i] == '+' ? ' ' : raw[i]);
+            }
+        }
+        return value;
+    }
+    return "";
+}
+
+// I derive every value from a hash of the lower-cased city (FNV-1a).
+static std::uint64_t cityHash(const std::string& city) {
+    std::uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : city) {
+        h ^= static_cast<std::uint64_t>(c >= 'A' && c <= 'Z' ? c + 32 : c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void answer(const http::request<http::string_body>& req, http::response<http::string_body>& res) {
+    std::string_view target(req.target().data(), req.target().size());
+    std::string key = queryParam(target, "key");
+    std::string city = queryParam(target, "q");
+
+    res.set(http::field::content_type, "application/json");
+    if (target.rfind("/v1/current.json", 0) != 0) {
+        res.result(http::status::not_found);
+        res.body() = R"({"error":{"code":1005,"message":"API URL is invalid."}})";
+        return;
+    }
+    if (key.empty()) {
+        res.result(http::status::unauthorized);
+        res.body() = R"({"error":{"code":1002,"message":"API key is invalid or not provided."}})";
+        return;
+    }
+    if (city.empty() || city.rfind("unknown", 0) == 0) {
+        res.result(http::status::bad_request);
+        res.body() = R"({"error":{"code":1006,"message":"No matching location found."}})";
+        return;
+    }
+
+    // I keep the echoed name JSON-safe without a full escaper.
+    std::string name;
+    for (char c : city.substr(0, 63)) {
+        if (c != '"' && c != '\\' && static_cast<unsigned char>(c) >= 0x20) name.push_back(c);
+    }
+
+    std::uint64_t h = cityHash(city);
+    double temp = static_cast<double>(h % 450) / 10.0 - 10.0;
+    double wind = static_cast<double>((h >> 12) % 400) / 10.0;
+    int humidity = static_cast<int>((h >> 24) % 80) + 20;
+    const auto& condition = kConditions[(h >> 32) % (sizeof(kConditions) / sizeof(kConditions[0]))];
+
+    char body[512];
+    std::snprintf(body, sizeof(body),
+        R"({"location":{"name":"%s","region":"","country":"Stubland","lat":0.0,"lon":0.0,)"
+        R"("tz_id":"UTC","localtime_epoch":1760612400,"localtime":"2025-10-16 11:00"},)"
+        R"("current":{"last_updated_epoch":1760611500,"last_updated":"2025-10-16 10:45",)"
+        R"("temp_c":%.1f,"temp_f":%.1f,"is_day":1,"condition":{"text":"%s",)"
+        R"("icon":"//cdn.weatherapi.com/weather/64x64/day/116.png","code":%s},)"
+        R"("wind_mph":%.1f,"wind_kph":%.1f,"wind_degree":%d,"wind_dir":"SW",)"
+        R"("pressure_mb":1016.0,"humidity":%d,"cloud":50,"uv":1.0}})",
+        name.c_str(), temp, temp * 9 / 5 + 32, condition[1], condition[0],
+        wind / 1.609, wind, static_cast<int>(h % 360), humidity);
+    res.body() = body;
+}
+
+class StubConnection : public std::enable_shared_from_this<StubConnection> {
+public:
+    StubConnection(tcp::socket&& socket, const StubOptions& opts)
+        : stream(std::move(socket)), timer(stream.get_executor()), options(opts) {}
+
+    void start() {
+        net::dispatch(stream.get_executor(),
+                      beast::bind_front_handler(&StubConnection::doRead, shared_from_this()));
+    }
+
+private:
+    void doRead() {
+        req = {};
+        stream.expires_after(std::chrono::seconds(60));
+        http::async_read(stream, buffer, req,
+                         beast::bind_front_handler(&StubConnection::onRead, shared_from_this()));
+    }
+
+    void onRead(beast::error_code ec, std::size_t) {
+        if (ec) return;
+
+        res = {};
+        res.version(req.version());
+        res.keep_alive(req.keep_alive());
+        res.result(http::status::ok);
+        answer(req, res);
+        res.prepare_payload();
+
+        // I wait on a timer, not a sleep, so latency costs no thread.
+        timer.expires_after(options.latency);
+        timer.async_wait(beast::bind_front_handler(&StubConnection::doWrite, shared_from_this()));
+    }
+
+    void doWrite(beast::error_code) {
+        http::async_write(stream, res,
+                          beast::bind_front_handler(&StubConnection::onWrite, shared_from_this()));
+    }
+
+    void onWrite(beast::error_code ec, std::size_t) {
+        if (ec) return;
+        if (!res.keep_alive()) {
+            stream.socket().shutdown(tcp::socket::shutdown_send, ec);
+            return;
+        }
+        doRead();
+    }
+
+    beast::tcp_stream stream;
+    net::steady_timer timer;
+    const StubOptions& options;
+    beast::flat_buffer buffer;
+    http::request<http::string_body> req;
+    http::response<http::string_body> res;
+};
+
+static void doAccept(tcp::acceptor& acceptor, net::io_context& ioc, const StubOptions& options) {
+    acceptor.async_accept(net::make_strand(ioc), [&acceptor, &ioc, &options](beast::error_code ec, tcp::socket socket) {
+        if (!ec) std::make_shared<StubConnection>(std::move(socket), options)->start();
+        doAccept(acceptor, ioc, options);
+    });
+}
+
+static void printUsage() {
+    std::printf("Usage: weather_upstream_stub [--address A] [--port N] [--threads N] [--latency-ms MS]\n");
+}
+
+int main(int argc, char* argv[]) {
+    StubOptions options;
+    for (int i = 1; i < argc; i += 2) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+        std::string value = argv[i + 1];
+
+        if (flag == "--address") options.address = value;
+        else if (flag == "--port") options.port = static_cast<unsigned short>(std::stoul(value));
+        else if (flag == "--threads") options.threads = static_cast<unsigned>(std::stoul(value));
+        else if (flag == "--latency-ms") options.latency = std::chrono::milliseconds(std::stoul(value));
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    try {
+        net::io_context ioc(static_cast<int>(options.threads));
+        tcp::endpoint endpoint{ net::ip::make_address(options.address), options.port };
+        tcp::acceptor acceptor(ioc);
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(net::socket_base::reuse_address(true));
+        acceptor.bind(endpoint);
+        acceptor.listen(net::socket_base::max_listen_connections);
+
+        net::signal_set signals(ioc, SIGINT, SIGTERM);
+        signals.async_wait([&ioc](const beast::error_code&, int) { ioc.stop(); });
+
+        doAccept(acceptor, ioc, options);
+        std::printf("Upstream stub on http://%s:%u (latency %lld ms)\n", options.address.c_str(),
+                    options.port, static_cast<long long>(options.latency.count()));
+        std::fflush(stdout);
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < options.threads; ++i) threads.emplace_back([&ioc] { ioc.run(); });
+        ioc.run();
+        for (auto& t : threads) t.join();
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "Fatal error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
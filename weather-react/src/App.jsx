@@ -1,4 +1,4 @@
-import React, { useMemo, useState } from "react";
+import React, { useEffect, useMemo, useState } from "react";
 import { api } from "./api";
 
 // I keep Field generic so it can be reused across auth and weather forms.
@@ -82,6 +82,7 @@ export default function App() {
 
   const [city, setCity] = useState("");
   const [weatherText, setWeatherText] = useState("");
+  const [liveCity, setLiveCity] = useState("");
   const [history, setHistory] = useState([]);
 
   const [busy, setBusy] = useState(false);
@@ -89,6 +90,18 @@ export default function App() {
 
   const isAuthed = useMemo(() => Boolean(token), [token]);
 
+  // I follow the last looked-up city over Server-Sent Events instead of
+  // polling, so the server fetches it once for all viewers.
+  useEffect(() => {
+    if (!token || !liveCity) return undefined;
+    return api.weatherStream(
+      liveCity,
+      token,
+      (res) => setWeatherText(res.summary),
+      (message) => setError(message)
+    );
+  }, [token, liveCity]);
+
   async function handleRegister(e) {
     e.preventDefault();
     setError("");
@@ -123,9 +136,12 @@ export default function App() {
   }
 
   function handleLogout() {
+    // I revoke the token server-side but never block the UI on it.
+    if (token) api.logout(token).catch(() => {});
     setToken("");
     setUsername("");
     setCity("");
+    setLiveCity("");
     setWeatherText("");
     setHistory([]);
     setError("");
@@ -139,6 +155,7 @@ export default function App() {
     try {
       const res = await api.weather(city, token);
       setWeatherText(res.summary);
+      setLiveCity(city);
     } catch (err) {
       setError(err.message);
     } finally {
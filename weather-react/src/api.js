@@ -2,16 +2,28 @@
 // talks to fetch() directly.
 const BASE_URL = "http://localhost:8080";
 
-async function request(path, { method = "GET", body, token } = {}) {
+// I remember the last ETag and body per cacheKey, so an unchanged
+// response comes back as an empty 304 and is served from here.
+const validators = new Map();
+
+async function request(path, { method = "GET", body, token, cacheKey } = {}) {
+  const cached = cacheKey ? validators.get(cacheKey) : undefined;
   const res = await fetch(`${BASE_URL}${path}`, {
     method,
+    // I revalidate myself; the browser cache would hide the 304.
+    cache: "no-store",
     headers: {
       "Content-Type": "application/json",
       ...(token ? { Authorization: `Bearer ${token}` } : {}),
+      ...(cached ? { "If-None-Match": cached.etag } : {}),
     },
     body: body ? JSON.stringify(body) : undefined,
   });
 
+  if (res.status === 304 && cached) {
+    return cached.data;
+  }
+
   const text = await res.text();
   let data;
   try {
@@ -24,6 +36,11 @@ async function request(path, { method = "GET", body, token } = {}) {
     throw new Error(data.error || "Request failed");
   }
 
+  const etag = res.headers.get("ETag");
+  if (cacheKey && etag) {
+    validators.set(cacheKey, { etag, data });
+  }
+
   return data;
 }
 
@@ -40,15 +57,35 @@ export const api = {
       body: { username, password },
     }),
 
+  logout: (token) =>
+    request("/auth/logout", {
+      method: "POST",
+      token,
+    }),
+
   weather: (city, token) =>
     request("/weather/current", {
       method: "POST",
       token,
       body: { city },
+      cacheKey: `weather:${token}:${city}`,
     }),
 
+  // I return a close function. EventSource cannot send headers, so the
+  // token travels in the query string.
+  weatherStream: (city, token, onWeather, onError) => {
+    const params = new URLSearchParams({ city, access_token: token });
+    const source = new EventSource(`${BASE_URL}/weather/stream?${params}`);
+    source.addEventListener("weather", (e) => onWeather(JSON.parse(e.data)));
+    source.addEventListener("error", (e) => {
+      if (e.data) onError(JSON.parse(e.data).error);
+    });
+    return () => source.close();
+  },
+
   history: (token) =>
     request("/history", {
       token,
+      cacheKey: `history:${token}`,
     }),
 };